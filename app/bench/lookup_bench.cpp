@@ -0,0 +1,124 @@
+#include "DatabaseManager.hpp"
+#include "StatementCache.hpp"
+#include "Types.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sqlite3.h>
+
+
+/**
+ * Times a single name lookup in the categorization database.
+ *
+ * The database is seeded with ROWS categorizations, then LOOKUPS names, half of
+ * them stored, are looked up three ways: preparing and finalizing the query for
+ * every lookup, reusing it through a StatementCache, and through
+ * DatabaseManager::get_categorization_from_db, which answers from the in-memory
+ * categorization cache once that has loaded.
+ *
+ * Usage: lookup_bench [rows] [lookups]
+ */
+
+static const char* LOOKUP_SQL =
+    "SELECT category, subcategory FROM file_categorization WHERE file_name = ? AND file_type = ? "
+    "ORDER BY id DESC LIMIT 1;";
+
+
+static std::string make_file_name(int index)
+{
+    return "file_" + std::to_string(index) + "_report.pdf";
+}
+
+
+static bool step_lookup(sqlite3_stmt* stmt, const std::string& file_name)
+{
+    sqlite3_bind_text(stmt, 1, file_name.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, "F", -1, SQLITE_STATIC);
+    return sqlite3_step(stmt) == SQLITE_ROW;
+}
+
+
+static void report(const char* label, int lookups, const std::function<size_t(int)>& lookup)
+{
+    size_t hits = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; ++i) {
+        hits += lookup(i);
+    }
+    const double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-36s %8.0f ns/lookup  (%zu hits)\n", label, elapsed / lookups, hits);
+}
+
+
+int main(int argc, char* argv[])
+{
+    const int rows = argc > 1 ? std::atoi(argv[1]) : 20000;
+    const int lookups = argc > 2 ? std::atoi(argv[2]) : 200000;
+    if (rows <= 0 || lookups <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [rows] [lookups]" << std::endl;
+        return 1;
+    }
+
+    const std::filesystem::path config_dir = std::filesystem::temp_directory_path() / "aifilesorter_lookup_bench";
+    std::filesystem::remove_all(config_dir);
+    std::filesystem::create_directories(config_dir);
+
+    DatabaseManager db_manager(config_dir.string());
+    std::vector<CategorizedFile> seed;
+    seed.reserve(rows);
+    for (int i = 0; i < rows; ++i) {
+        seed.push_back({"/home/user/Downloads/dir" + std::to_string(i % 50), make_file_name(i),
+                        FileType::File, "Documents", "Reports"});
+    }
+    if (!db_manager.insert_or_update_files_with_categorization(seed).get()) {
+        std::cerr << "Failed to seed the database" << std::endl;
+        return 1;
+    }
+
+    sqlite3* db = nullptr;
+    const std::string db_file = (config_dir / "categorization_results.db").string();
+    if (sqlite3_open_v2(db_file.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
+        return 1;
+    }
+
+    // Every other name is stored, the rest are misses
+    std::vector<std::string> names;
+    names.reserve(lookups);
+    for (int i = 0; i < lookups; ++i) {
+        names.push_back(make_file_name(static_cast<int>((i * 7919LL) % (2LL * rows))));
+    }
+
+    std::printf("%d rows, %d lookups\n", rows, lookups);
+
+    report("prepare/finalize per lookup", lookups, [&](int i) -> size_t {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db, LOOKUP_SQL, -1, &stmt, nullptr) != SQLITE_OK) {
+            return 0;
+        }
+        const bool hit = step_lookup(stmt, names[i]);
+        sqlite3_finalize(stmt);
+        return hit;
+    });
+
+    StatementCache statements;
+    statements.attach(db);
+    report("cached statement", lookups, [&](int i) -> size_t {
+        auto stmt = statements.acquire(LOOKUP_SQL);
+        return stmt && step_lookup(stmt.get(), names[i]);
+    });
+
+    report("get_categorization_from_db", lookups, [&](int i) -> size_t {
+        return !db_manager.get_categorization_from_db(names[i], FileType::File).empty();
+    });
+
+    statements.clear();
+    sqlite3_close(db);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef CATEGORIZATIONCACHE_HPP
+#define CATEGORIZATIONCACHE_HPP
+
+#include "MappedFile.hpp"
+#include "Types.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sqlite3.h>
+
+
+class CategorizationCache {
+public:
+    enum class Lookup { NotLoaded, Miss, Hit };
+
+    CategorizationCache() = default;
+    CategorizationCache(const CategorizationCache&) = delete;
+    CategorizationCache& operator=(const CategorizationCache&) = delete;
+    ~CategorizationCache();
+
+    void start_loading(const std::string &db_file, const std::string &snapshot_file);
+    void stop_loading();
+    bool is_loaded() const;
+
+    Lookup lookup(const std::string &file_name, FileType file_type, Categorization &categorization) const;
+    void store(const std::string &file_name, FileType file_type, const Categorization &categorization);
+    void forget(const std::string &file_name, FileType file_type);
+
+    bool save_snapshot(int64_t generation);
+
+private:
+    // One entry of the open-addressing table, in memory and in the snapshot alike
+    struct Slot {
+        uint64_t hash;
+        uint32_t name_offset;
+        uint32_t name_length;
+        uint32_t label;
+        uint32_t file_type;
+    };
+
+    // The loaded entries: owned vectors, or views into a mapped snapshot
+    struct Table {
+        std::vector<Slot> owned_slots;
+        std::string owned_names;
+        std::unique_ptr<MappedFile> mapping;
+        const Slot *slots = nullptr;
+        uint64_t slot_mask = 0;
+        const char *names = nullptr;
+        uint64_t names_size = 0;
+        std::vector<Categorization> labels;
+        size_t entry_count = 0;
+        int64_t generation = 0;
+        bool from_snapshot = false;
+
+        const Slot *find(std::string_view file_name, FileType file_type, uint64_t hash) const;
+    };
+
+    struct Entry {
+        std::string file_name;
+        FileType file_type;
+        uint32_t label;
+    };
+
+    std::string snapshot_file;
+    std::thread loader;
+    std::atomic<bool> stop_loader{false};
+    std::atomic<bool> loaded{false};
+
+    mutable std::shared_mutex mutex;
+    std::unique_ptr<Table> table;
+    // Writes since the table was read, which take precedence over it; an empty optional forgets the entry
+    std::unordered_map<std::string, std::optional<Categorization>> overlay;
+
+    void load(const std::string &db_file);
+    std::unique_ptr<Table> map_snapshot(int64_t generation) const;
+    std::unique_ptr<Table> read_database(sqlite3 *db, int64_t generation) const;
+
+    static uint64_t hash_entry(std::string_view file_name, FileType file_type);
+    static std::string overlay_key(std::string_view file_name, FileType file_type);
+    static std::unique_ptr<Table> build_table(const std::vector<Entry> &entries,
+                                              std::vector<Categorization> labels, int64_t generation);
+    static bool write_snapshot(const std::string &path, const Table &table);
+};
+
+#endif
@@ -1,14 +1,16 @@
 #ifndef CATEGORIZATIONSESSION_HPP
 #define CATEGORIZATIONSESSION_HPP
 
+#include <LLMBackend.hpp>
 #include <LLMClient.hpp>
 #include <string>
 
 class CategorizationSession {
+    LLMBackend backend;
     std::string key;
 
 public:
-    CategorizationSession();
+    CategorizationSession(const LLMBackend& backend);
     ~CategorizationSession();
 
     LLMClient create_llm_client() const;
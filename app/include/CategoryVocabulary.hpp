@@ -0,0 +1,42 @@
+#ifndef CATEGORYVOCABULARY_HPP
+#define CATEGORYVOCABULARY_HPP
+
+#include "Types.hpp"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+class CategoryVocabulary {
+public:
+    struct Entry {
+        int id;
+        int parent_id; // 0 for categories, the category id for subcategories
+        std::string name;
+        long use_count;
+    };
+
+    void add(const Entry &entry);
+    void add_use(int id, long count = 1);
+    void merge(const CategoryVocabulary &changes);
+    void clear();
+    int find(const std::string &name, int parent_id) const;
+    std::string get_name(int id) const;
+    size_t size() const;
+
+    Categorization canonicalize(const Categorization &categorization) const;
+    std::vector<Entry> get_most_used(size_t max_categories, size_t max_subcategories) const;
+
+    static std::string normalize(const std::string &name);
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<int, Entry> entries;
+    std::unordered_map<std::string, int> ids_by_key;
+
+    static std::string make_key(const std::string &name, int parent_id);
+    int find_locked(const std::string &name, int parent_id) const;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef CIRCUITBREAKER_HPP
+#define CIRCUITBREAKER_HPP
+
+#include <chrono>
+#include <mutex>
+
+
+class CircuitBreaker {
+public:
+    enum class State { Closed, Open, HalfOpen };
+
+    CircuitBreaker(int failure_threshold = 3,
+                   std::chrono::milliseconds open_duration = std::chrono::seconds(30),
+                   std::chrono::milliseconds max_open_duration = std::chrono::minutes(10));
+
+    bool allow_request();
+    void record_success();
+    void record_failure();
+    bool is_open() const;
+    State get_state() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    mutable std::mutex mutex;
+    State state = State::Closed;
+    int failure_threshold;
+    int consecutive_failures = 0;
+    std::chrono::milliseconds base_open_duration;
+    std::chrono::milliseconds max_open_duration;
+    std::chrono::milliseconds open_duration;
+    Clock::time_point retry_at;
+    Clock::time_point probe_started;
+    bool probe_in_flight = false;
+
+    void open(Clock::time_point now);
+};
+
+#endif
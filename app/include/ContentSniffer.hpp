@@ -0,0 +1,31 @@
+#ifndef CONTENTSNIFFER_HPP
+#define CONTENTSNIFFER_HPP
+
+#include "Types.hpp"
+#include <optional>
+#include <string>
+#include <string_view>
+
+
+class ContentSniffer {
+public:
+    struct Result {
+        std::string description;
+        Categorization categorization;
+        bool is_confident;
+    };
+
+    static std::optional<Result> sniff(const std::string &path);
+    static std::optional<Result> identify(std::string_view header);
+    static bool has_informative_extension(const std::string &file_name);
+
+private:
+    static constexpr size_t header_size = 8192;
+
+    static std::optional<Result> identify_zip(std::string_view header);
+    static std::optional<Result> identify_iso_media(std::string_view header);
+    static std::optional<Result> identify_riff(std::string_view header);
+    static std::optional<Result> identify_executable(std::string_view header);
+};
+
+#endif
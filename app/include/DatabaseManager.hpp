@@ -1,35 +1,172 @@
 #ifndef DATABASEMANAGER_HPP
 #define DATABASEMANAGER_HPP
 
+#include "CategorizationCache.hpp"
+#include "CategoryVocabulary.hpp"
+#include "MpscQueue.hpp"
+#include "NameClassifier.hpp"
+#include "StatementCache.hpp"
 #include "Types.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <map>
+#include <optional>
+#include <span>
+#include <thread>
 #include <vector>
 #include <sqlite3.h>
 
 class DatabaseManager {
 public:
+    struct MaintenanceReport {
+        size_t rows_checked = 0;
+        size_t rows_pruned = 0;
+        int64_t bytes_reclaimed = 0;
+        bool completed = false;
+    };
+
     DatabaseManager(std::string config_dir);
     ~DatabaseManager();
 
     bool is_file_already_categorized(const std::string &file_name);
-    bool insert_or_update_file_with_categorization(const std::string& file_name,
-                                                   const std::string& file_type,
-                                                   const std::string& dir_path, 
-                                                   const std::string& category, 
-                                                   const std::string& subcategory);
+    std::future<bool> insert_or_update_file_with_categorization(const std::string& file_name,
+                                                                const std::string& file_type,
+                                                                const std::string& dir_path, 
+                                                                const std::string& category, 
+                                                                const std::string& subcategory);
+    std::future<bool> insert_or_update_files_with_categorization(const std::vector<CategorizedFile>& files,
+                                                                 bool confirmed = true);
     std::vector<std::string> get_dir_contents_from_db(const std::string &dir_path);
 
     std::vector<CategorizedFile> get_categorized_files(const std::string &directory_path);
 
     std::vector<std::string>
         get_categorization_from_db(const std::string& file_name, const FileType file_type);
+    std::vector<std::optional<Categorization>> lookup_many(std::span<const FileEntry> entries);
+    std::vector<std::optional<FileFingerprint>> get_fingerprints(std::span<const FileEntry> entries);
+    std::future<bool> store_fingerprints(const std::vector<FileEntry>& entries);
+    std::vector<std::string>
+        get_categorization_from_template(const std::string& file_name, const FileType file_type);
+
+    const CategoryVocabulary& get_vocabulary() const;
+    const NameClassifier& get_classifier() const;
+
+    std::future<bool> enqueue_pending_categorizations(const std::vector<FileEntry>& entries);
+    std::vector<FileEntry> get_pending_categorizations(size_t limit);
+    std::future<bool> remove_pending_categorizations(const std::vector<FileEntry>& entries);
+    std::future<bool> record_pending_attempts(const std::vector<FileEntry>& entries);
+
+    void wait_for_writes();
+
+    MaintenanceReport run_maintenance(const std::atomic<bool>& stop_flag);
 
 private:
-    std::map<std::string, std::string> cached_results;
-    std::string get_cached_category(const std::string &file_name);
-    void load_cache();
+    struct WriteRequest {
+        std::function<bool()> apply;
+        std::function<void()> on_commit;
+        std::promise<bool> done;
+        bool standalone = false;
+    };
+
+    struct ReadConnection {
+        sqlite3* db = nullptr;
+        StatementCache statements;
+
+        ~ReadConnection();
+    };
+
+    // A read connection checked out of the pool, given back when the lease ends
+    class ReadLease {
+    public:
+        ReadLease(DatabaseManager& owner, std::unique_ptr<ReadConnection> connection)
+            : owner(owner), connection(std::move(connection)) {}
+        ReadLease(const ReadLease&) = delete;
+        ReadLease& operator=(const ReadLease&) = delete;
+        ~ReadLease() { owner.release_reader(std::move(connection)); }
+
+        ReadConnection* operator->() const { return connection.get(); }
+
+    private:
+        DatabaseManager& owner;
+        std::unique_ptr<ReadConnection> connection;
+    };
+
+    enum class VocabularyScope { Request, Transaction };
+
+    struct StaleRow {
+        sqlite3_int64 dir_id;
+        std::string file_name;
+        std::string file_type;
+        bool categorized;
+    };
+
+    struct StoredCategorization {
+        CategorizedFile file;
+        std::optional<Categorization> previous; // The confirmed categorization the row replaced
+    };
+
     bool file_exists_in_db(const std::string &file_name, const std::string &file_path);
+    bool update_name_template(sqlite3_stmt* stmt,
+                              const std::string& file_name,
+                              const std::string& file_type,
+                              const std::string& category,
+                              const std::string& subcategory);
+    void backfill_name_templates();
+    void configure_connection(sqlite3* connection, bool writable);
+    bool run_migrations();
+    bool create_base_schema();
+    bool intern_directory_paths();
+    bool track_cache_generation();
+    bool create_fingerprint_table();
+    bool add_confirmed_flag();
+    bool bump_cache_generation();
+    int64_t get_cache_generation();
+    bool has_column(const std::string& table, const std::string& column);
+    bool ensure_vocabulary_columns();
+    void load_vocabulary();
+    void backfill_vocabulary_ids();
+    sqlite3_int64 intern_directory(const std::string& dir_path);
+    int intern_category(const std::string& name, int parent_id, long uses = 1);
+    void settle_vocabulary_changes(VocabularyScope scope, bool kept);
+    bool write_categorizations(const std::vector<CategorizedFile>& files, bool confirmed,
+                               std::vector<StoredCategorization>& stored);
+    bool write_pending_categorizations(const std::vector<FileEntry>& entries);
+    bool update_pending(const char* sql, const std::vector<FileEntry>& entries);
+    std::future<bool> submit_write(std::function<bool()> apply, std::function<void()> on_commit = nullptr);
+    std::future<bool> submit_standalone(std::function<bool()> apply);
+    void run_writer();
+    void commit_write_group(std::vector<WriteRequest>& group);
+    ReadLease reader();
+    void release_reader(std::unique_ptr<ReadConnection> connection);
+    void find_by_name(std::span<const FileEntry> entries, std::vector<std::optional<Categorization>>& found);
+    void find_by_fingerprint(std::span<const FileEntry> entries, std::vector<std::optional<Categorization>>& found);
+    std::future<bool> prune_stale_rows(const std::vector<StaleRow>& rows);
+    bool compact_database(const std::atomic<bool>& stop_flag, int64_t& bytes_reclaimed);
+    int64_t get_pragma(const char* pragma);
+    bool run_interruptible(const char* sql, const std::atomic<bool>& stop_flag);
+    void train_classifier();
+
+    CategoryVocabulary vocabulary;
+    // Vocabulary changes of the write being applied, and of the rest of its transaction
+    CategoryVocabulary request_vocabulary;
+    CategoryVocabulary transaction_vocabulary;
+    NameClassifier classifier;
+    StatementCache statements;
+    CategorizationCache cache;
+
+    MpscQueue<WriteRequest> write_queue;
+    std::thread writer;
+    std::mutex writer_mutex;
+    std::condition_variable writer_wakeup;
+    bool stop_writer = false;
+
+    std::mutex readers_mutex;
+    std::vector<std::unique_ptr<ReadConnection>> idle_readers;
 
     sqlite3* db;
     const std::string config_dir;
@@ -0,0 +1,32 @@
+#ifndef FINGERPRINTER_HPP
+#define FINGERPRINTER_HPP
+
+#include "Types.hpp"
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+class Fingerprinter {
+public:
+    static std::optional<FileFingerprint> read_metadata(const std::string &path);
+    static uint64_t hash_contents(const std::string &path, uint64_t size);
+    static uint64_t hash(std::string_view data, uint64_t seed = 0);
+
+    static void fingerprint_files(std::vector<FileEntry> &entries,
+                                  std::span<const std::optional<FileFingerprint>> known,
+                                  const std::atomic<bool> *cancel_flag = nullptr);
+
+private:
+    static constexpr size_t head_size = 64 * 1024;
+    static constexpr size_t tail_size = 64 * 1024;
+    static constexpr size_t middle_block_size = 16 * 1024;
+    static constexpr size_t middle_block_count = 8;
+    static constexpr size_t max_threads = 8;
+};
+
+#endif
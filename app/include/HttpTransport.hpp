@@ -0,0 +1,60 @@
+#ifndef HTTPTRANSPORT_HPP
+#define HTTPTRANSPORT_HPP
+
+#include <atomic>
+#include <curl/curl.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+using HeaderList = std::shared_ptr<curl_slist>;
+
+struct HttpRequest {
+    std::string url;
+    std::string body;
+    bool is_post = false;
+    const curl_slist* headers = nullptr;
+    long timeout_seconds = 30;
+    long connect_timeout_seconds = 10;
+    const std::atomic<bool>* cancel_flag = nullptr;
+};
+
+struct HttpResponse {
+    long status_code = 0;
+    std::string body;
+    std::map<std::string, std::string> headers;
+
+    std::string get_header(const std::string& name) const;
+};
+
+
+class HttpTransport {
+public:
+    static HttpTransport& shared();
+    static HeaderList make_header_list(const std::vector<std::string>& headers);
+
+    HttpResponse perform(const HttpRequest& request);
+
+    HttpTransport(const HttpTransport&) = delete;
+    HttpTransport& operator=(const HttpTransport&) = delete;
+
+private:
+    HttpTransport();
+    ~HttpTransport();
+
+    CURLSH* share;
+    std::mutex share_mutexes[CURL_LOCK_DATA_LAST];
+    std::mutex pool_mutex;
+    std::vector<CURL*> idle_handles;
+
+    CURL* acquire_handle();
+    void release_handle(CURL* handle);
+    void configure_handle(CURL* handle, const HttpRequest& request, HttpResponse& response);
+    static void lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* user_data);
+    static void unlock_share(CURL* handle, curl_lock_data data, void* user_data);
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef LLMBACKEND_HPP
+#define LLMBACKEND_HPP
+
+#include <string>
+
+
+struct LLMBackend {
+    std::string base_url = "https://api.openai.com/v1";
+    std::string model = "gpt-4o-mini";
+    std::string auth_header = "Authorization: Bearer {api_key}";
+    std::string api_key;
+    long timeout_seconds = 10;
+    double prompt_price_per_million = 0.15;
+    double completion_price_per_million = 0.60;
+    bool structured_output = true;
+
+    std::string get_chat_completions_url() const;
+    std::string get_auth_header_line(const std::string &key) const;
+    std::string get_host() const;
+    bool is_local() const;
+    bool uses_embedded_key() const;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef LLMCASSETTE_HPP
+#define LLMCASSETTE_HPP
+
+#include "CategoryVocabulary.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+class LLMCassette {
+public:
+    enum class Mode { Off, Record, Replay };
+
+    LLMCassette(const std::string& path, Mode mode,
+                std::chrono::milliseconds replay_latency = std::chrono::milliseconds(0));
+
+    Mode get_mode() const;
+    size_t size() const;
+    std::optional<std::string> find(const std::string& payload) const;
+    bool simulate_latency(const std::atomic<bool>* cancel_flag) const;
+    void record(const std::string& payload, const std::string& response_body);
+    std::vector<CategoryVocabulary::Entry> pin_vocabulary(const std::vector<CategoryVocabulary::Entry>& offered);
+
+    static Mode parse_mode(const std::string& value);
+    static uint64_t hash_payload(const std::string& payload);
+
+private:
+    std::string path;
+    Mode mode;
+    std::chrono::milliseconds replay_latency;
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, std::string> responses;
+    std::optional<std::vector<CategoryVocabulary::Entry>> vocabulary;
+    bool legacy_format = false;
+    std::ofstream output;
+    bool header_pending = false;
+
+    void load();
+    void write_header();
+};
+
+#endif
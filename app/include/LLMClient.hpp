@@ -1,18 +1,90 @@
 #ifndef LLMCLIENT_HPP
 #define LLMCLIENT_HPP
 
+#include <CategoryVocabulary.hpp>
+#include <CircuitBreaker.hpp>
+#include <HttpTransport.hpp>
+#include <LLMBackend.hpp>
+#include <LLMCassette.hpp>
+#include <LLMUsageTracker.hpp>
+#include <RateLimiter.hpp>
+#include <RetryPolicy.hpp>
 #include <Types.hpp>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Json {
+class Value;
+}
+
+
+class LLMRequestError : public std::runtime_error {
+public:
+    LLMRequestError(const std::string& message, long status_code)
+        : std::runtime_error(message), status_code(status_code) {}
+
+    long get_status_code() const { return status_code; }
+    bool is_fatal() const { return status_code == 401 || status_code == 403; }
+
+private:
+    long status_code;
+};
+
+
+class LLMUnavailableError : public std::runtime_error {
+public:
+    explicit LLMUnavailableError(const std::string& message)
+        : std::runtime_error(message) {}
+};
+
 
 class LLMClient {
 public:
-    LLMClient(const std::string &api_key);
-    std::string categorize_file(const std::string& file_name, const FileType file_type);
+    LLMClient(const LLMBackend &backend, const std::string &api_key);
+    void set_cancel_flag(const std::atomic<bool>* flag);
+    void set_rate_limiter(std::shared_ptr<RateLimiter> limiter);
+    void set_retry_policy(const RetryPolicy& policy);
+    void set_cassette(std::shared_ptr<LLMCassette> cassette);
+    void set_usage_tracker(std::shared_ptr<LLMUsageTracker> tracker);
+    void set_vocabulary(const std::vector<CategoryVocabulary::Entry>& entries);
+    void set_circuit_breaker(std::shared_ptr<CircuitBreaker> breaker);
+    std::vector<std::optional<Categorization>>
+        categorize_files(std::span<const FileEntry> entries);
 
 private:
+    enum class AnswerCheck { Valid, Repaired, Rejected };
+
+    LLMBackend backend;
     std::string api_key;
-    std::string send_api_request(std::string json_payload);
-    std::string make_payload(const std::string &file_name, const FileType file_type);
+    HeaderList headers;
+    const std::atomic<bool>* cancel_flag = nullptr;
+    std::shared_ptr<RateLimiter> rate_limiter;
+    RetryPolicy retry_policy;
+    std::shared_ptr<LLMCassette> cassette;
+    std::shared_ptr<LLMUsageTracker> usage_tracker;
+    std::shared_ptr<CircuitBreaker> circuit_breaker;
+    std::string vocabulary_prompt;
+    std::unordered_map<int, std::string> vocabulary_names;
+    static constexpr int max_batch_attempts = 3;
+
+    std::string send_api_request(const std::string& json_payload, long timeout_seconds);
+    HttpResponse perform_with_retries(const HttpRequest& request, double estimated_tokens, int& attempts);
+    HttpResponse replay_from_cassette(const std::string& json_payload);
+    std::string make_batch_payload(std::span<const FileEntry> entries,
+                                   const std::vector<size_t>& indices);
+    LLMUsageTracker::ParseOutcome parse_batch_response(const std::string& content,
+                                                       std::span<const FileEntry> entries,
+                                                       const std::vector<size_t>& indices,
+                                                       std::vector<std::optional<Categorization>>& results);
+    static Json::Value extract_answers(const std::string& content);
+    static AnswerCheck validate_categorization(Categorization& answer);
+    static double parse_confidence(const Json::Value& value);
 };
 
 #endif
@@ -0,0 +1,77 @@
+#ifndef LLMUSAGETRACKER_HPP
+#define LLMUSAGETRACKER_HPP
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+class LLMUsageTracker {
+public:
+    struct RequestRecord {
+        long status_code = 0;
+        int attempts = 0;
+        long prompt_tokens = 0;
+        long completion_tokens = 0;
+        double latency_ms = 0.0;
+        bool replayed = false;
+    };
+
+    struct ParseOutcome {
+        size_t expected = 0;
+        size_t accepted = 0;
+        size_t repaired = 0;
+        size_t rejected = 0;
+        bool malformed = false;
+    };
+
+    struct Summary {
+        size_t requests = 0;
+        size_t failed_requests = 0;
+        long retries = 0;
+        long prompt_tokens = 0;
+        long completion_tokens = 0;
+        double cost = 0.0;
+        double total_latency_ms = 0.0;
+        double p50_ms = 0.0;
+        double p95_ms = 0.0;
+        double p99_ms = 0.0;
+        double max_ms = 0.0;
+        double elapsed_seconds = 0.0;
+        size_t parsed_responses = 0;
+        size_t malformed_responses = 0;
+        size_t answers_accepted = 0;
+        size_t answers_repaired = 0;
+        size_t answers_rejected = 0;
+        size_t answers_missing = 0;
+    };
+
+    LLMUsageTracker(const std::string &model,
+                    double prompt_price_per_million,
+                    double completion_price_per_million);
+
+    void record(const RequestRecord &request);
+    void record_parse(const ParseOutcome &outcome);
+    Summary summarize() const;
+    std::string format_summary() const;
+    bool dump_json(const std::string &path) const;
+    bool append_history(const std::string &path) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::string model;
+    double prompt_price_per_million;
+    double completion_price_per_million;
+    Clock::time_point started;
+    std::chrono::system_clock::time_point started_wall;
+    mutable std::mutex mutex;
+    std::vector<RequestRecord> requests;
+    std::vector<ParseOutcome> parses;
+
+    static double percentile(const std::vector<double> &sorted_values, double fraction);
+    std::string to_json(const Summary &summary, bool with_requests) const;
+};
+
+#endif
@@ -3,17 +3,27 @@
 
 #include "CategorizationDialog.hpp"
 #include "CategorizationProgressDialog.hpp"
+#include "CircuitBreaker.hpp"
 #include "DatabaseManager.hpp"
 #include "FileScanner.hpp"
+#include "LLMCassette.hpp"
 #include "LLMClient.hpp"
+#include "LLMUsageTracker.hpp"
+#include "ModelRouter.hpp"
+#include "RateLimiter.hpp"
+#include "RuleEngine.hpp"
 #include "Settings.hpp"
+#include "SingleFlight.hpp"
 
 #include <gtk/gtk.h>
 #include <gtkmm/builder.h>
 #include <gtkmm/dialog.h>
 #include <gtkmm/treeview.h>
 #include <gtkmm/liststore.h>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <optional>
 #include <spdlog/logger.h>
 #include <string>
 #include <thread>
@@ -45,7 +55,7 @@ public:
     void show_error_dialog(const std::string &message);
 
     std::thread analyze_thread;
-    bool stop_analysis;
+    std::atomic<bool> stop_analysis;
 
     struct AnalysisContext {
         MainApp* app;
@@ -65,6 +75,7 @@ private:
     GtkWidget* main_window;
     Settings settings;
     DatabaseManager db_manager;
+    RuleEngine rule_engine;
     CategorizationDialog* categorization_dialog;
     FileScanner dirscanner;
     GtkEntry* path_entry;
@@ -77,6 +88,22 @@ private:
     FileScanOptions file_scan_options;
     CheckboxData* data_for_files = nullptr;
     CheckboxData* data_for_directories = nullptr;
+    std::shared_ptr<RateLimiter> rate_limiter;
+    std::shared_ptr<LLMCassette> cassette;
+    SingleFlight llm_requests;
+    std::shared_ptr<LLMUsageTracker> llm_usage;
+    std::shared_ptr<LLMUsageTracker> strong_llm_usage;
+    std::shared_ptr<CircuitBreaker> circuit_breaker = std::make_shared<CircuitBreaker>();
+    std::shared_ptr<CircuitBreaker> strong_circuit_breaker = std::make_shared<CircuitBreaker>();
+    std::thread drain_thread;
+    std::atomic<bool> stop_drain{false};
+    std::atomic<bool> drain_running{false};
+    guint drain_timer_id = 0;
+    std::thread maintenance_thread;
+    std::atomic<bool> stop_maintenance{false};
+    std::atomic<bool> maintenance_running{false};
+    guint maintenance_timer_id = 0;
+    std::chrono::steady_clock::time_point next_maintenance{};
 
     GtkApplication *create_app();
     void initialize_checkboxes();
@@ -100,12 +127,34 @@ private:
     std::string get_folder_path();
     std::vector<CategorizedFile>
         categorize_files(const std::vector<FileEntry>& files);
-    std::string categorize_with_timeout(LLMClient &llm, const std::string &item_name,
-                                        const FileType file_type, int timeout_seconds);
-    std::tuple<std::string, std::string> categorize_file(LLMClient &llm,
-                                                         const std::string &item_name,
-                                                         const FileType file_type,
-                                                         const std::function<void(const std::string&)>& report_progress);
+    std::optional<Categorization> resolve_locally(const FileEntry &entry,
+                                                  const std::optional<Categorization> &stored);
+    std::optional<Categorization> classify_by_content(FileEntry &entry);
+    std::optional<Categorization> predict_by_name(const FileEntry &entry);
+    void categorize_pending(const std::vector<FileEntry> &items,
+                            const std::vector<size_t> &pending,
+                            std::vector<std::optional<CategorizedFile>> &results);
+    void categorize_with_llm(ModelRouter &router,
+                             const std::vector<FileEntry> &items,
+                             const std::vector<size_t> &pending,
+                             std::vector<std::optional<CategorizedFile>> &results);
+    void report_progress(const std::string &message);
+    void defer_failed_batch(const std::vector<FileEntry> &batch_entries, const std::string &reason);
+    bool is_llm_reachable();
+    void start_pending_queue_drain();
+    void stop_pending_queue_drain();
+    static gboolean on_drain_timer(gpointer user_data);
+    void drain_pending_queue();
+    void record_drain_attempts(const std::vector<FileEntry>& entries);
+    void start_database_maintenance();
+    void stop_database_maintenance();
+    static gboolean on_maintenance_timer(gpointer user_data);
+    void run_database_maintenance();
+    void report_llm_usage();
+    std::shared_ptr<RateLimiter> get_rate_limiter();
+    std::shared_ptr<LLMCassette> get_cassette();
+    ModelRouter create_model_router(const std::atomic<bool>* cancel_flag);
+    LLMClient create_llm_client(const LLMBackend &backend, const std::atomic<bool>* cancel_flag);
     std::vector<FileEntry> find_files_to_categorize(
         const std::string& directory_path, const std::unordered_set<std::string>& cached_files);
     static void on_analyze_button_clicked(GtkButton *button, gpointer user_data);
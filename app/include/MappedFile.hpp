@@ -0,0 +1,30 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+class MappedFile {
+public:
+    MappedFile(const std::string &path, size_t max_bytes = 0);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const;
+    const unsigned char* data() const;
+    size_t size() const;
+    std::string_view view() const;
+
+private:
+    const unsigned char* mapped = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* mapping_handle = nullptr;
+#endif
+};
+
+#endif
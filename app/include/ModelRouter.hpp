@@ -0,0 +1,50 @@
+#ifndef MODELROUTER_HPP
+#define MODELROUTER_HPP
+
+#include <LLMClient.hpp>
+#include <Types.hpp>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+
+class ModelRouter {
+public:
+    struct Policy {
+        double escalation_threshold = 0.7;
+        bool escalate_conflicts = true;
+    };
+
+    struct Stats {
+        size_t requested = 0;
+        size_t answered_by_fast_tier = 0;
+        size_t escalated_unanswered = 0;
+        size_t escalated_low_confidence = 0;
+        size_t escalated_conflicting = 0;
+        size_t answered_by_strong_tier = 0;
+        size_t failed_escalations = 0;
+    };
+
+    explicit ModelRouter(LLMClient fast_tier);
+    ModelRouter(LLMClient fast_tier, LLMClient strong_tier, const Policy& policy);
+
+    std::vector<std::optional<Categorization>>
+        categorize_files(std::span<const FileEntry> entries);
+    bool has_strong_tier() const;
+    Stats get_stats() const;
+    std::string format_stats() const;
+
+private:
+    LLMClient fast_tier;
+    std::optional<LLMClient> strong_tier;
+    Policy policy;
+    mutable std::mutex mutex;
+    Stats stats;
+
+    std::vector<bool> find_conflicts(std::span<const FileEntry> entries,
+                                     const std::vector<std::optional<Categorization>>& answers) const;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef MPSCQUEUE_HPP
+#define MPSCQUEUE_HPP
+
+#include <atomic>
+#include <utility>
+
+
+/**
+ * @brief An unbounded lock-free queue for many producers and a single consumer.
+ *
+ * Producers link a new node with one atomic exchange and never wait for each
+ * other or for the consumer. The consumer owns the tail, a node whose value was
+ * already taken, and advances it as it pops. Between the exchange and the
+ * link of a push the new item is not visible yet, so a producer has to wake
+ * the consumer only after push() returns.
+ */
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head(new Node), tail(head.load()) {}
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue()
+    {
+        T value;
+        while (try_pop(value)) {
+        }
+        delete tail;
+    }
+
+    /**
+     * @brief Appends an item. Safe to call from any thread.
+     */
+    void push(T value)
+    {
+        Node *node = new Node;
+        node->value = std::move(value);
+        Node *previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * @brief Takes the oldest item. Only the consumer thread may call this.
+     *
+     * @return true if an item was taken, false if the queue is empty.
+     */
+    bool try_pop(T &value)
+    {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+    /**
+     * @brief Tells whether the consumer would find nothing to pop. Only the consumer thread may call this.
+     */
+    bool empty() const
+    {
+        return tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value{};
+    };
+
+    std::atomic<Node*> head;
+    Node *tail;
+};
+
+#endif
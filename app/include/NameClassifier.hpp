@@ -0,0 +1,43 @@
+#ifndef NAMECLASSIFIER_HPP
+#define NAMECLASSIFIER_HPP
+
+#include "Types.hpp"
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+class NameClassifier {
+public:
+    void learn(const std::string &file_name, FileType file_type,
+               const Categorization &categorization, int weight = 1);
+    std::optional<Categorization> predict(const std::string &file_name, FileType file_type) const;
+    size_t sample_count() const;
+
+    static std::vector<uint32_t> extract_features(const std::string &file_name, FileType file_type);
+
+private:
+    struct Label {
+        Categorization categorization;
+        long samples = 0;
+        long feature_total = 0;
+    };
+
+    static constexpr uint32_t FEATURE_BITS = 18;
+    static constexpr double SMOOTHING = 0.5;
+
+    mutable std::mutex mutex;
+    std::vector<Label> labels;
+    std::unordered_map<std::string, uint32_t> label_ids;
+    // Per hashed feature, how often it occurred with each label
+    std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, long>>> postings;
+    long total_samples = 0;
+
+    static uint32_t hash_feature(const std::string &feature);
+};
+
+#endif
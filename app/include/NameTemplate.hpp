@@ -0,0 +1,20 @@
+#ifndef NAMETEMPLATE_HPP
+#define NAMETEMPLATE_HPP
+
+#include <string>
+
+
+class NameTemplate {
+public:
+    static std::string derive(const std::string &file_name);
+
+private:
+    static size_t match_uuid(const std::string &text, size_t pos);
+    static size_t match_hash(const std::string &text, size_t pos);
+    static size_t match_date(const std::string &text, size_t pos);
+    static size_t match_version(const std::string &text, size_t pos);
+    static size_t match_digits(const std::string &text, size_t pos);
+    static bool is_boundary(const std::string &text, size_t pos);
+};
+
+#endif
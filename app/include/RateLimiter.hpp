@@ -0,0 +1,40 @@
+#ifndef RATELIMITER_HPP
+#define RATELIMITER_HPP
+
+#include "HttpTransport.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+
+class RateLimiter {
+public:
+    RateLimiter(double requests_per_minute, double tokens_per_minute);
+
+    bool acquire(double tokens, const std::atomic<bool>* cancel_flag);
+    void release_unused(double tokens);
+    void pause_for(std::chrono::milliseconds delay);
+    void update_from_headers(const HttpResponse& response);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Bucket {
+        double capacity;
+        double available;
+        double refill_per_second;
+    };
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    Bucket requests;
+    Bucket tokens;
+    Clock::time_point last_refill;
+    Clock::time_point paused_until;
+
+    void refill(Clock::time_point now);
+    static void update_bucket(Bucket& bucket, const HttpResponse& response, const std::string& kind);
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef RETRYPOLICY_HPP
+#define RETRYPOLICY_HPP
+
+#include "HttpTransport.hpp"
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+
+
+class RetryPolicy {
+public:
+    RetryPolicy(int max_attempts = 5,
+                std::chrono::milliseconds base_delay = std::chrono::milliseconds(500),
+                std::chrono::milliseconds max_delay = std::chrono::seconds(60));
+
+    int get_max_attempts() const;
+    std::chrono::milliseconds next_delay(int attempt, const HttpResponse* response = nullptr) const;
+
+    static bool is_retryable_status(long status_code);
+    static std::optional<std::chrono::milliseconds> parse_retry_after(const HttpResponse& response);
+    static std::optional<std::chrono::milliseconds> parse_duration(const std::string& value);
+    static bool wait(std::chrono::milliseconds delay, const std::atomic<bool>* cancel_flag);
+
+private:
+    int max_attempts;
+    std::chrono::milliseconds base_delay;
+    std::chrono::milliseconds max_delay;
+};
+
+#endif
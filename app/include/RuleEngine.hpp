@@ -0,0 +1,43 @@
+#ifndef RULEENGINE_HPP
+#define RULEENGINE_HPP
+
+#include "Types.hpp"
+#include <filesystem>
+#include <optional>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+class RuleEngine {
+public:
+    RuleEngine(const std::string &config_dir);
+
+    bool load();
+    void reload_if_changed();
+    std::optional<Categorization> match(const FileEntry &entry) const;
+    size_t get_rule_count() const;
+
+private:
+    enum class PatternKind {Glob, Regex};
+
+    struct PatternRule {
+        PatternKind kind;
+        std::string pattern;
+        std::regex regex;
+        Categorization categorization;
+    };
+
+    std::string rules_file;
+    std::filesystem::file_time_type loaded_write_time;
+    std::unordered_map<std::string, Categorization> extension_rules;
+    std::vector<PatternRule> pattern_rules;
+
+    bool write_default_rules() const;
+    bool parse_rule(const std::string &line, int line_number);
+    static std::string to_lower(const std::string &text);
+    static bool glob_match(const std::string &pattern, const std::string &text);
+};
+
+#endif
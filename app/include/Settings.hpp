@@ -2,6 +2,7 @@
 #define SETTINGS_HPP
 
 #include <IniConfig.hpp>
+#include <LLMBackend.hpp>
 #include <string>
 #include <filesystem>
 
@@ -26,6 +27,31 @@ public:
     std::string get_sort_folder() const;
     void set_sort_folder(const std::string &path);
 
+    int get_max_concurrent_requests() const;
+    void set_max_concurrent_requests(int value);
+
+    int get_batch_size() const;
+    void set_batch_size(int value);
+
+    int get_max_retries() const;
+    int get_requests_per_minute() const;
+    int get_tokens_per_minute() const;
+
+    LLMBackend get_llm_backend() const;
+
+    bool get_routing_enabled() const;
+    LLMBackend get_strong_llm_backend() const;
+    double get_escalation_threshold() const;
+    bool get_escalate_conflicts() const;
+
+    bool get_classifier_enabled() const;
+    double get_classifier_min_confidence() const;
+    int get_classifier_min_samples() const;
+
+    std::string get_cassette_mode() const;
+    std::string get_cassette_path() const;
+    int get_cassette_latency_ms() const;
+
     std::string define_config_path();
     std::string get_config_dir();
 
@@ -43,6 +69,28 @@ private:
     const char *default_sort_folder;
     std::string sort_folder;
     std::string skipped_version;
+    int max_concurrent_requests;
+    int batch_size;
+    int max_retries;
+    int requests_per_minute;
+    int tokens_per_minute;
+    LLMBackend llm_backend;
+    bool routing_enabled;
+    LLMBackend strong_llm_backend;
+    double escalation_threshold;
+    bool escalate_conflicts;
+    bool classifier_enabled;
+    double classifier_min_confidence;
+    int classifier_min_samples;
+    std::string cassette_mode;
+    std::string cassette_path;
+    int cassette_latency_ms;
+
+    int get_int_value(const std::string &section, const std::string &key, int default_value) const;
+    double get_double_value(const std::string &section, const std::string &key, double default_value) const;
+    LLMBackend read_llm_backend(const std::string &section,
+                                const LLMBackend &defaults = LLMBackend()) const;
+    void write_llm_backend(const std::string &section, const LLMBackend &backend);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef SINGLEFLIGHT_HPP
+#define SINGLEFLIGHT_HPP
+
+#include "Types.hpp"
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+
+class SingleFlight {
+public:
+    using Result = std::optional<Categorization>;
+
+    struct Ticket {
+        bool is_owner;
+        std::shared_future<Result> result;
+    };
+
+    static std::string make_key(const std::string &file_name, FileType file_type);
+
+    Ticket join(const std::string &key);
+    void complete(const std::string &key, const Result &result);
+    size_t size() const;
+
+private:
+    struct Flight {
+        std::promise<Result> promise;
+        std::shared_future<Result> result;
+        bool completed = false;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Flight> flights;
+};
+
+#endif
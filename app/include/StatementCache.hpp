@@ -0,0 +1,57 @@
+#ifndef STATEMENTCACHE_HPP
+#define STATEMENTCACHE_HPP
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <sqlite3.h>
+
+
+class StatementCache {
+    struct Slot {
+        sqlite3_stmt *stmt = nullptr;
+        bool in_use = false;
+        std::mutex *mutex = nullptr;
+    };
+
+public:
+    class Statement {
+    public:
+        Statement() = default;
+        Statement(Statement &&other) noexcept;
+        Statement &operator=(Statement &&other) noexcept;
+        Statement(const Statement &) = delete;
+        Statement &operator=(const Statement &) = delete;
+        ~Statement();
+
+        sqlite3_stmt *get() const { return stmt; }
+        explicit operator bool() const { return stmt != nullptr; }
+        void reset();
+
+    private:
+        friend class StatementCache;
+
+        Statement(sqlite3_stmt *stmt, Slot *slot);
+        void release();
+
+        sqlite3_stmt *stmt = nullptr;
+        Slot *slot = nullptr;
+    };
+
+    StatementCache() = default;
+    StatementCache(const StatementCache &) = delete;
+    StatementCache &operator=(const StatementCache &) = delete;
+    ~StatementCache();
+
+    void attach(sqlite3 *db);
+    Statement acquire(const char *sql);
+    void clear();
+    size_t size() const;
+
+private:
+    sqlite3 *db = nullptr;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Slot> slots;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef TYPES_HPP
 #define TYPES_HPP
 
+#include <cstdint>
+#include <optional>
 #include <string>
 
 enum class FileType {File, Directory};
@@ -13,6 +15,12 @@ struct CategorizedFile {
     std::string subcategory;
 };
 
+struct Categorization {
+    std::string category;
+    std::string subcategory;
+    double confidence = 1.0;
+};
+
 inline std::string to_string(FileType type) {
     switch (type) {
         case FileType::File: return "File";
@@ -21,10 +29,19 @@ inline std::string to_string(FileType type) {
     }
 }
 
+// Identifies the contents of a file independently of its name and location
+struct FileFingerprint {
+    uint64_t size = 0;
+    int64_t mtime = 0;         // Only tells whether content_hash has to be recomputed
+    uint64_t content_hash = 0; // Hash of sampled blocks of the contents
+};
+
 struct FileEntry {
     std::string full_path;
     std::string file_name;
     FileType type;
+    std::string content_type; // Detected from the file contents, empty if unknown
+    std::optional<FileFingerprint> fingerprint; // Set for files fingerprinted while scanning
 };
 
 enum class FileScanOptions {
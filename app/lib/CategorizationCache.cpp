@@ -0,0 +1,495 @@
+#include "CategorizationCache.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <glib.h>
+#include <mutex>
+
+
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[8] = {'A', 'F', 'O', 'C', 'A', 'C', 'H', 'E'};
+constexpr uint32_t SNAPSHOT_FORMAT = 1;
+
+// The snapshot is this header, the slots, the name bytes and the labels, in that order
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t label_count;
+    int64_t generation;
+    uint64_t slot_count;
+    uint64_t entry_count;
+    uint64_t names_size;
+    uint64_t labels_size;
+    uint64_t reserved;
+};
+static_assert(sizeof(SnapshotHeader) == 64, "the slots must start 8-byte aligned");
+
+
+void append_string(std::string &out, const std::string &value)
+{
+    const uint32_t length = static_cast<uint32_t>(value.size());
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.append(value);
+}
+
+
+bool read_string(std::string_view &in, std::string &value)
+{
+    uint32_t length;
+    if (in.size() < sizeof(length)) {
+        return false;
+    }
+    std::memcpy(&length, in.data(), sizeof(length));
+    in.remove_prefix(sizeof(length));
+    if (in.size() < length) {
+        return false;
+    }
+    value.assign(in.data(), length);
+    in.remove_prefix(length);
+    return true;
+}
+
+}
+
+
+CategorizationCache::~CategorizationCache()
+{
+    stop_loading();
+}
+
+
+/**
+ * @brief Starts filling the cache on a background thread.
+ *
+ * The loader opens its own read-only connection, so the caller's connection
+ * stays free. It maps the snapshot when the snapshot was written at the
+ * current generation of the database, and reads the whole
+ * 'file_categorization' table otherwise. Until it is done, lookup() answers
+ * NotLoaded and the caller has to ask the database.
+ *
+ * @param db_file The database file.
+ * @param snapshot_file The file the snapshot is mapped from and saved to.
+ */
+void CategorizationCache::start_loading(const std::string &db_file, const std::string &snapshot_file)
+{
+    stop_loading();
+    this->snapshot_file = snapshot_file;
+    stop_loader = false;
+    loader = std::thread(&CategorizationCache::load, this, db_file);
+}
+
+
+/**
+ * @brief Abandons a load in progress and waits for the loader to exit.
+ */
+void CategorizationCache::stop_loading()
+{
+    stop_loader = true;
+    if (loader.joinable()) {
+        loader.join();
+    }
+}
+
+
+/**
+ * @brief Tells whether the table was loaded, so that lookups no longer need the database.
+ */
+bool CategorizationCache::is_loaded() const
+{
+    return loaded;
+}
+
+
+/**
+ * @brief Looks up the categorization stored for a name.
+ *
+ * @param file_name The name of the file or directory.
+ * @param file_type The type of the entry.
+ * @param categorization Receives the categorization on a hit.
+ *
+ * @return Hit or Miss once the cache is loaded, NotLoaded before.
+ */
+CategorizationCache::Lookup CategorizationCache::lookup(const std::string &file_name, FileType file_type,
+                                                        Categorization &categorization) const
+{
+    std::shared_lock lock(mutex);
+    if (!table) {
+        return Lookup::NotLoaded;
+    }
+
+    if (!overlay.empty()) {
+        auto it = overlay.find(overlay_key(file_name, file_type));
+        if (it != overlay.end()) {
+            if (!it->second) {
+                return Lookup::Miss;
+            }
+            categorization = *it->second;
+            return Lookup::Hit;
+        }
+    }
+
+    const Slot *slot = table->find(file_name, file_type, hash_entry(file_name, file_type));
+    if (!slot || slot->label >= table->labels.size()) {
+        return Lookup::Miss;
+    }
+    categorization = table->labels[slot->label];
+    return Lookup::Hit;
+}
+
+
+/**
+ * @brief Records a categorization written to the database.
+ *
+ * Writes are kept even while the cache is loading, and shadow whatever the
+ * loader reads for the same name.
+ */
+void CategorizationCache::store(const std::string &file_name, FileType file_type,
+                                const Categorization &categorization)
+{
+    std::unique_lock lock(mutex);
+    overlay[overlay_key(file_name, file_type)] = Categorization{categorization.category, categorization.subcategory};
+}
+
+
+/**
+ * @brief Records that the categorization of a name was removed from the database.
+ */
+void CategorizationCache::forget(const std::string &file_name, FileType file_type)
+{
+    std::unique_lock lock(mutex);
+    overlay[overlay_key(file_name, file_type)] = std::nullopt;
+}
+
+
+/**
+ * @brief Saves the loaded table and the writes made since as a snapshot.
+ *
+ * The snapshot is written to a temporary file and renamed over the old one,
+ * so a crash leaves either snapshot intact. Nothing is written when the
+ * mapped snapshot is still current.
+ *
+ * @param generation The generation of the database the cache reflects.
+ *
+ * @return true if the snapshot on disk is current, false otherwise.
+ */
+bool CategorizationCache::save_snapshot(int64_t generation)
+{
+    std::unique_lock lock(mutex);
+    if (!table || snapshot_file.empty()) {
+        return false;
+    }
+    if (table->from_snapshot && overlay.empty() && table->generation == generation) {
+        return true;
+    }
+
+    std::vector<Entry> entries;
+    entries.reserve(table->entry_count + overlay.size());
+    std::vector<Categorization> labels = table->labels;
+    for (uint64_t i = 0; i <= table->slot_mask; ++i) {
+        const Slot &slot = table->slots[i];
+        if (slot.hash == 0 || slot.name_offset + uint64_t(slot.name_length) > table->names_size) {
+            continue;
+        }
+        const FileType file_type = static_cast<FileType>(slot.file_type);
+        std::string file_name(table->names + slot.name_offset, slot.name_length);
+        if (overlay.count(overlay_key(file_name, file_type)) == 0) {
+            entries.push_back({std::move(file_name), file_type, slot.label});
+        }
+    }
+
+    std::unordered_map<std::string, uint32_t> label_ids;
+    for (const auto &[key, categorization] : overlay) {
+        if (!categorization) {
+            continue;
+        }
+        const std::string label_key = categorization->category + '\x1f' + categorization->subcategory;
+        auto [it, inserted] = label_ids.try_emplace(label_key, static_cast<uint32_t>(labels.size()));
+        if (inserted) {
+            labels.push_back(*categorization);
+        }
+        entries.push_back({key.substr(1), key[0] == 'D' ? FileType::Directory : FileType::File, it->second});
+    }
+
+    std::unique_ptr<Table> merged = build_table(entries, std::move(labels), generation);
+    // The old snapshot is unmapped first, since a mapped file cannot be replaced everywhere
+    table = std::move(merged);
+    overlay.clear();
+
+    return write_snapshot(snapshot_file, *table);
+}
+
+
+/**
+ * @brief Loads the table on the loader thread.
+ */
+void CategorizationCache::load(const std::string &db_file)
+{
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(db_file.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        g_print("Categorization cache: can't open database: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return;
+    }
+
+    // The generation and the rows are read in one transaction, so they agree
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    int64_t generation = -1;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT generation FROM cache_state;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            generation = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    std::unique_ptr<Table> loaded_table = generation >= 0 ? map_snapshot(generation) : nullptr;
+    if (!loaded_table) {
+        loaded_table = read_database(db, generation);
+    }
+    sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+
+    if (!loaded_table) {
+        return;
+    }
+
+    std::unique_lock lock(mutex);
+    table = std::move(loaded_table);
+    loaded = true;
+}
+
+
+/**
+ * @brief Maps the snapshot if it is intact and was written at the given generation.
+ */
+std::unique_ptr<CategorizationCache::Table> CategorizationCache::map_snapshot(int64_t generation) const
+{
+    auto mapping = std::make_unique<MappedFile>(snapshot_file);
+    if (!mapping->is_open() || mapping->size() < sizeof(SnapshotHeader)) {
+        return nullptr;
+    }
+
+    SnapshotHeader header;
+    std::memcpy(&header, mapping->data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.format != SNAPSHOT_FORMAT || header.generation != generation ||
+        header.slot_count == 0 || (header.slot_count & (header.slot_count - 1)) != 0 ||
+        header.slot_count > mapping->size() / sizeof(Slot)) {
+        return nullptr;
+    }
+
+    const uint64_t slots_size = header.slot_count * sizeof(Slot);
+    if (sizeof(SnapshotHeader) + slots_size + header.names_size + header.labels_size != mapping->size()) {
+        return nullptr;
+    }
+
+    auto table = std::make_unique<Table>();
+    const unsigned char *data = mapping->data();
+    std::string_view labels(reinterpret_cast<const char*>(data) + sizeof(SnapshotHeader) + slots_size + header.names_size,
+                            header.labels_size);
+    table->labels.resize(header.label_count);
+    for (auto &label : table->labels) {
+        if (!read_string(labels, label.category) || !read_string(labels, label.subcategory)) {
+            return nullptr;
+        }
+    }
+
+    table->slots = reinterpret_cast<const Slot*>(data + sizeof(SnapshotHeader));
+    table->slot_mask = header.slot_count - 1;
+    table->names = reinterpret_cast<const char*>(data) + sizeof(SnapshotHeader) + slots_size;
+    table->names_size = header.names_size;
+    table->entry_count = header.entry_count;
+    table->generation = generation;
+    table->from_snapshot = true;
+    table->mapping = std::move(mapping);
+    return table;
+}
+
+
+/**
+ * @brief Builds the table from every row of 'file_categorization'.
+ *
+ * Rows are read in insertion order, so when a name was stored in several
+ * directories the last one stored wins.
+ *
+ * @return The table, or nullptr if the query failed or loading was stopped.
+ */
+std::unique_ptr<CategorizationCache::Table> CategorizationCache::read_database(sqlite3 *db, int64_t generation) const
+{
+    const char *sql = "SELECT file_name, file_type, category, subcategory FROM file_categorization ORDER BY id;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        g_print("Categorization cache: SQL error: %s\n", sqlite3_errmsg(db));
+        return nullptr;
+    }
+
+    std::vector<Entry> entries;
+    std::vector<Categorization> labels;
+    std::unordered_map<std::string, uint32_t> label_ids;
+    std::string label_key;
+    while (!stop_loader && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* file_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* file_type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+
+        label_key.assign(category ? category : "");
+        label_key += '\x1f';
+        label_key += subcategory ? subcategory : "";
+        auto [it, inserted] = label_ids.try_emplace(label_key, static_cast<uint32_t>(labels.size()));
+        if (inserted) {
+            labels.push_back(Categorization{category ? category : "", subcategory ? subcategory : ""});
+        }
+
+        const FileType type = (file_type && std::strcmp(file_type, "D") == 0) ? FileType::Directory : FileType::File;
+        entries.push_back({file_name ? file_name : "", type, it->second});
+    }
+    sqlite3_finalize(stmt);
+
+    if (stop_loader) {
+        return nullptr;
+    }
+    return build_table(entries, std::move(labels), generation);
+}
+
+
+/**
+ * @brief Builds an owned table, at most half full so that probe sequences stay short.
+ *
+ * Later entries replace earlier entries for the same name.
+ */
+std::unique_ptr<CategorizationCache::Table> CategorizationCache::build_table(
+    const std::vector<Entry> &entries, std::vector<Categorization> labels, int64_t generation)
+{
+    auto table = std::make_unique<Table>();
+    uint64_t capacity = 16;
+    while (capacity < entries.size() * 2) {
+        capacity *= 2;
+    }
+
+    table->owned_slots.assign(capacity, Slot{0, 0, 0, 0, 0});
+    table->slot_mask = capacity - 1;
+    for (const auto &entry : entries) {
+        const uint64_t hash = hash_entry(entry.file_name, entry.file_type);
+        uint64_t index = hash & table->slot_mask;
+        while (true) {
+            Slot &slot = table->owned_slots[index];
+            if (slot.hash == 0) {
+                slot = Slot{hash, static_cast<uint32_t>(table->owned_names.size()),
+                            static_cast<uint32_t>(entry.file_name.size()), entry.label,
+                            static_cast<uint32_t>(entry.file_type)};
+                table->owned_names += entry.file_name;
+                ++table->entry_count;
+                break;
+            }
+            if (slot.hash == hash && slot.file_type == static_cast<uint32_t>(entry.file_type) &&
+                std::string_view(table->owned_names).substr(slot.name_offset, slot.name_length) == entry.file_name) {
+                slot.label = entry.label;
+                break;
+            }
+            index = (index + 1) & table->slot_mask;
+        }
+    }
+
+    table->slots = table->owned_slots.data();
+    table->names = table->owned_names.data();
+    table->names_size = table->owned_names.size();
+    table->labels = std::move(labels);
+    table->generation = generation;
+    return table;
+}
+
+
+/**
+ * @brief Writes a table to a snapshot file, replacing the previous snapshot atomically.
+ */
+bool CategorizationCache::write_snapshot(const std::string &path, const Table &table)
+{
+    std::string labels;
+    for (const auto &label : table.labels) {
+        append_string(labels, label.category);
+        append_string(labels, label.subcategory);
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.format = SNAPSHOT_FORMAT;
+    header.label_count = static_cast<uint32_t>(table.labels.size());
+    header.generation = table.generation;
+    header.slot_count = table.slot_mask + 1;
+    header.entry_count = table.entry_count;
+    header.names_size = table.names_size;
+    header.labels_size = labels.size();
+
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(table.slots), header.slot_count * sizeof(Slot));
+        out.write(table.names, table.names_size);
+        out.write(labels.data(), labels.size());
+        if (!out) {
+            g_print("Categorization cache: failed to write %s\n", temp_path.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        g_print("Categorization cache: failed to replace %s: %s\n", path.c_str(), error.message().c_str());
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Probes for a name, comparing the full name only when the hash matches.
+ */
+const CategorizationCache::Slot *CategorizationCache::Table::find(std::string_view file_name, FileType file_type,
+                                                                  uint64_t hash) const
+{
+    uint64_t index = hash & slot_mask;
+    while (true) {
+        const Slot &slot = slots[index];
+        if (slot.hash == 0) {
+            return nullptr;
+        }
+        if (slot.hash == hash && slot.file_type == static_cast<uint32_t>(file_type) &&
+            slot.name_length == file_name.size() && slot.name_offset + uint64_t(slot.name_length) <= names_size &&
+            std::memcmp(names + slot.name_offset, file_name.data(), file_name.size()) == 0) {
+            return &slot;
+        }
+        index = (index + 1) & slot_mask;
+    }
+}
+
+
+/**
+ * @brief Hashes a name and its type (64-bit FNV-1a); 0 is reserved for empty slots.
+ */
+uint64_t CategorizationCache::hash_entry(std::string_view file_name, FileType file_type)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : file_name) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    hash ^= static_cast<uint64_t>(file_type) + 1;
+    hash *= 1099511628211ull;
+    return hash == 0 ? 1 : hash;
+}
+
+
+/**
+ * @brief Builds the overlay key of a name, its type letter followed by the name.
+ */
+std::string CategorizationCache::overlay_key(std::string_view file_name, FileType file_type)
+{
+    std::string key(1, file_type == FileType::Directory ? 'D' : 'F');
+    key += file_name;
+    return key;
+}
@@ -509,22 +509,33 @@ void CategorizationDialog::on_subcategory_cell_edited(
 /**
  * Records the categorization of all files in the tree view to the database.
  *
- * This function iterates over the tree view's model and inserts or updates each
- * file's categorization in the database. The data is stored in the file_categorization
- * table with the file name, file type, directory path, category, and subcategory
- * as columns. If the file already exists in the database, its category and
- * subcategory are updated. If the file does not exist in the database, a new
- * entry is inserted.
+ * This function collects every row of the tree view's model and queues all of
+ * them to be inserted or updated in the database in a single transaction, so the
+ * UI does not wait for the write. The data is stored in the
+ * file_categorization table with the file name, file type, directory path, category,
+ * and subcategory as columns. If the file already exists in the database, its
+ * category and subcategory are updated. If the file does not exist in the database,
+ * a new entry is inserted.
+ *
+ * The write is best effort: the GTK thread does not wait for it, and rows that
+ * fail are reported by the writer thread. The next analysis waits for it to be
+ * committed before reading (see DatabaseManager::wait_for_writes).
  */
 void CategorizationDialog::record_categorization_to_db()
 {
     auto files = get_categorized_files_from_treeview();
+    std::vector<CategorizedFile> rows;
+    rows.reserve(files.size());
     int index = 0;
 
     for (const auto& [file_name, file_type, category, subcategory] : files) {
         std::string full_file_path = categorized_files[index].file_path;
         std::string dir_path = std::filesystem::path(full_file_path).string();
-        db_manager->insert_or_update_file_with_categorization(file_name, file_type, dir_path, category, subcategory);
+        rows.push_back(CategorizedFile{dir_path, file_name,
+                                       file_type == "D" ? FileType::Directory : FileType::File,
+                                       category, subcategory});
         index++;
     }
+
+    db_manager->insert_or_update_files_with_categorization(rows);
 }
\ No newline at end of file
@@ -6,8 +6,23 @@
 #include <cstdlib>   // For std::getenv
 
 
-CategorizationSession::CategorizationSession()
+/**
+ * Prepares the credentials for a categorization run against the given backend.
+ *
+ * A key configured for the backend is used as is. The key embedded in the
+ * application is only decrypted for the OpenAI API when no key is configured,
+ * so local backends work without the decryption environment variables.
+ *
+ * @param backend The backend the LLM clients of this session talk to.
+ */
+CategorizationSession::CategorizationSession(const LLMBackend& backend)
+    : backend(backend),
+      key(backend.api_key)
 {
+    if (!backend.uses_embedded_key()) {
+        return;
+    }
+
     const char* env_pc = std::getenv("ENV_PC");
     const char* env_rr = std::getenv("ENV_RR");
 
@@ -29,5 +44,5 @@ CategorizationSession::~CategorizationSession()
 
 LLMClient CategorizationSession::create_llm_client() const
 {
-    return LLMClient(key);
+    return LLMClient(backend, key);
 }
\ No newline at end of file
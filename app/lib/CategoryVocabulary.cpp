@@ -0,0 +1,248 @@
+#include "CategoryVocabulary.hpp"
+#include <algorithm>
+#include <cctype>
+
+
+/**
+ * @brief Adds a category or subcategory, as stored in the database.
+ *
+ * @param entry The vocabulary entry. An entry whose normalized name is already
+ *              known under the same parent does not replace the existing one.
+ */
+void CategoryVocabulary::add(const Entry &entry)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[entry.id] = entry;
+    ids_by_key.try_emplace(make_key(entry.name, entry.parent_id), entry.id);
+}
+
+
+/**
+ * @brief Counts more uses of a vocabulary entry.
+ *
+ * @param id The entry.
+ * @param count The number of uses to add.
+ */
+void CategoryVocabulary::add_use(int id, long count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(id);
+    if (it != entries.end()) {
+        it->second.use_count += count;
+    }
+}
+
+
+/**
+ * @brief Applies the changes collected in another vocabulary.
+ *
+ * Entries this vocabulary already has gain the use count of the change;
+ * others are added as they are.
+ *
+ * @param changes The new entries and the uses to add to existing ones.
+ */
+void CategoryVocabulary::merge(const CategoryVocabulary &changes)
+{
+    std::vector<Entry> changed;
+    {
+        std::lock_guard<std::mutex> lock(changes.mutex);
+        changed.reserve(changes.entries.size());
+        for (const auto &[id, entry] : changes.entries) {
+            changed.push_back(entry);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &entry : changed) {
+        auto it = entries.find(entry.id);
+        if (it != entries.end()) {
+            it->second.use_count += entry.use_count;
+        } else {
+            entries[entry.id] = entry;
+            ids_by_key.try_emplace(make_key(entry.name, entry.parent_id), entry.id);
+        }
+    }
+}
+
+
+/**
+ * @brief Removes all entries.
+ */
+void CategoryVocabulary::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    ids_by_key.clear();
+}
+
+
+/**
+ * @brief Looks up a name in the vocabulary.
+ *
+ * Names are matched by their normalized form, so "documents", "Document"
+ * and " Documents " all find "Documents".
+ *
+ * @param name The category or subcategory name.
+ * @param parent_id 0 to look up a category, or the category id to look up one of its subcategories.
+ * @return The id of the entry, or 0 if the name is not in the vocabulary.
+ */
+int CategoryVocabulary::find(const std::string &name, int parent_id) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return find_locked(name, parent_id);
+}
+
+
+int CategoryVocabulary::find_locked(const std::string &name, int parent_id) const
+{
+    auto it = ids_by_key.find(make_key(name, parent_id));
+    return it == ids_by_key.end() ? 0 : it->second;
+}
+
+
+/**
+ * @brief Retrieves the name of a vocabulary entry.
+ *
+ * @return The name, or an empty string if the id is unknown.
+ */
+std::string CategoryVocabulary::get_name(int id) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(id);
+    return it == entries.end() ? std::string() : it->second.name;
+}
+
+
+/**
+ * @brief Retrieves the number of categories and subcategories in the vocabulary.
+ */
+size_t CategoryVocabulary::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+
+/**
+ * @brief Replaces the names of a categorization by their spelling in the vocabulary.
+ *
+ * Names that are not in the vocabulary are kept, trimmed, so that new
+ * categories can still be introduced.
+ *
+ * @param categorization The categorization to canonicalize.
+ * @return The categorization using the existing names where there are any.
+ */
+Categorization CategoryVocabulary::canonicalize(const Categorization &categorization) const
+{
+    auto trim = [](const std::string &text) {
+        const auto is_space = [](unsigned char c) { return std::isspace(c); };
+        auto first = std::find_if_not(text.begin(), text.end(), is_space);
+        auto last = std::find_if_not(text.rbegin(), text.rend(), is_space).base();
+        return first < last ? std::string(first, last) : std::string();
+    };
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Categorization result{trim(categorization.category), trim(categorization.subcategory)};
+
+    const int category_id = find_locked(result.category, 0);
+    if (category_id == 0) {
+        return result;
+    }
+    result.category = entries.at(category_id).name;
+
+    const int subcategory_id = find_locked(result.subcategory, category_id);
+    if (subcategory_id != 0) {
+        result.subcategory = entries.at(subcategory_id).name;
+    }
+    return result;
+}
+
+
+/**
+ * @brief Retrieves the most used categories, each followed by its most used subcategories.
+ *
+ * This is the part of the vocabulary offered to the LLM, so the size of the
+ * prompt stays bounded however large the vocabulary grows.
+ *
+ * @param max_categories The number of categories to return at most.
+ * @param max_subcategories The number of subcategories to return at most, over all categories.
+ * @return The selected entries, categories by decreasing use, each followed by its subcategories.
+ */
+std::vector<CategoryVocabulary::Entry>
+CategoryVocabulary::get_most_used(size_t max_categories, size_t max_subcategories) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto by_use = [](const Entry &a, const Entry &b) {
+        return a.use_count != b.use_count ? a.use_count > b.use_count : a.id < b.id;
+    };
+
+    std::vector<Entry> categories;
+    std::vector<Entry> subcategories;
+    for (const auto &[id, entry] : entries) {
+        (entry.parent_id == 0 ? categories : subcategories).push_back(entry);
+    }
+
+    std::sort(categories.begin(), categories.end(), by_use);
+    if (categories.size() > max_categories) {
+        categories.resize(max_categories);
+    }
+
+    std::unordered_map<int, size_t> selected_categories;
+    for (size_t i = 0; i < categories.size(); ++i) {
+        selected_categories[categories[i].id] = i;
+    }
+
+    std::erase_if(subcategories, [&](const Entry &entry) { return !selected_categories.contains(entry.parent_id); });
+    std::sort(subcategories.begin(), subcategories.end(), by_use);
+    if (subcategories.size() > max_subcategories) {
+        subcategories.resize(max_subcategories);
+    }
+
+    std::stable_sort(subcategories.begin(), subcategories.end(), [&](const Entry &a, const Entry &b) {
+        return selected_categories[a.parent_id] < selected_categories[b.parent_id];
+    });
+
+    std::vector<Entry> result;
+    result.reserve(categories.size() + subcategories.size());
+    auto next_subcategory = subcategories.begin();
+    for (const auto &category : categories) {
+        result.push_back(category);
+        while (next_subcategory != subcategories.end() && next_subcategory->parent_id == category.id) {
+            result.push_back(*next_subcategory++);
+        }
+    }
+    return result;
+}
+
+
+/**
+ * @brief Reduces a name to the form used to detect near-synonyms.
+ *
+ * ASCII letters are case-folded, other ASCII characters than letters and
+ * digits are dropped and a trailing plural "s" is removed, so "Documents",
+ * "document" and "Docu-ments" normalize alike.
+ */
+std::string CategoryVocabulary::normalize(const std::string &name)
+{
+    std::string key;
+    key.reserve(name.size());
+    for (unsigned char c : name) {
+        if (c >= 0x80) {
+            key += static_cast<char>(c); // Keep UTF-8 sequences as they are
+        } else if (std::isalnum(c)) {
+            key += static_cast<char>(std::tolower(c));
+        }
+    }
+    if (key.size() > 3 && key.back() == 's' && key[key.size() - 2] != 's') {
+        key.pop_back();
+    }
+    return key;
+}
+
+
+std::string CategoryVocabulary::make_key(const std::string &name, int parent_id)
+{
+    return std::to_string(parent_id) + ":" + normalize(name);
+}
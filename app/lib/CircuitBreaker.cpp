@@ -0,0 +1,121 @@
+#include "CircuitBreaker.hpp"
+#include <algorithm>
+
+
+/**
+ * @brief Constructs a closed circuit breaker.
+ *
+ * @param failure_threshold The number of consecutive failed requests that opens the circuit.
+ * @param open_duration How long the circuit stays open before a probe request is let through.
+ * @param max_open_duration The upper bound of the open duration, which doubles
+ *                          every time a probe fails.
+ */
+CircuitBreaker::CircuitBreaker(int failure_threshold,
+                               std::chrono::milliseconds open_duration,
+                               std::chrono::milliseconds max_open_duration)
+    : failure_threshold(std::max(1, failure_threshold)),
+      base_open_duration(open_duration),
+      max_open_duration(max_open_duration),
+      open_duration(open_duration)
+{}
+
+
+/**
+ * @brief Tells whether a request may be sent now.
+ *
+ * While the circuit is open, requests fail fast until the open duration has
+ * passed. Then a single probe request is let through; its outcome closes the
+ * circuit again or keeps it open for longer. A probe that never reports back,
+ * e.g. because it was cancelled, is replaced after another open duration.
+ *
+ * @return true if the request may be sent, false if it should fail fast.
+ */
+bool CircuitBreaker::allow_request()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto now = Clock::now();
+
+    switch (state) {
+        case State::Closed:
+            return true;
+        case State::Open:
+            if (now < retry_at) {
+                return false;
+            }
+            state = State::HalfOpen;
+            break;
+        case State::HalfOpen:
+            if (probe_in_flight && now - probe_started < open_duration) {
+                return false;
+            }
+            break;
+    }
+
+    probe_in_flight = true;
+    probe_started = now;
+    return true;
+}
+
+
+/**
+ * @brief Records a request that reached the endpoint, closing the circuit.
+ */
+void CircuitBreaker::record_success()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    state = State::Closed;
+    consecutive_failures = 0;
+    open_duration = base_open_duration;
+    probe_in_flight = false;
+}
+
+
+/**
+ * @brief Records a request that failed because the endpoint is unreachable or failing.
+ *
+ * Opens the circuit once the failure threshold is reached, or right away when
+ * the failed request was the probe.
+ */
+void CircuitBreaker::record_failure()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto now = Clock::now();
+
+    if (state == State::HalfOpen) {
+        open_duration = std::min(open_duration * 2, max_open_duration);
+        open(now);
+        return;
+    }
+
+    if (++consecutive_failures >= failure_threshold && state == State::Closed) {
+        open(now);
+    }
+}
+
+
+void CircuitBreaker::open(Clock::time_point now)
+{
+    state = State::Open;
+    retry_at = now + open_duration;
+    probe_in_flight = false;
+}
+
+
+/**
+ * @brief Tells whether requests are currently failing fast.
+ */
+bool CircuitBreaker::is_open() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return state == State::Open && Clock::now() < retry_at;
+}
+
+
+/**
+ * @brief Retrieves the state of the circuit.
+ */
+CircuitBreaker::State CircuitBreaker::get_state() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return state;
+}
@@ -0,0 +1,277 @@
+#include "ContentSniffer.hpp"
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+
+
+namespace {
+
+struct Signature {
+    size_t offset;
+    std::string_view magic;
+    const char* description;
+    const char* category;
+    const char* subcategory;
+    bool is_confident;
+};
+
+using namespace std::string_view_literals;
+
+// Plain magic numbers. Containers that need a closer look (ZIP, ISO media,
+// RIFF, executables) are handled by the identify_* helpers.
+const Signature SIGNATURES[] = {
+    {0, "%PDF-"sv, "PDF document", "Documents", "PDFs", true},
+    {0, "\x89PNG\r\n\x1a\n"sv, "PNG image", "Images", "PNG", true},
+    {0, "\xff\xd8\xff"sv, "JPEG image", "Images", "Photos", true},
+    {0, "GIF87a"sv, "GIF image", "Images", "GIF", true},
+    {0, "GIF89a"sv, "GIF image", "Images", "GIF", true},
+    {0, "BM"sv, "bitmap image", "Images", "Bitmaps", false},
+    {0, "II*\0"sv, "TIFF image", "Images", "TIFF", true},
+    {0, "MM\0*"sv, "TIFF image", "Images", "TIFF", true},
+    {0, "8BPS"sv, "Photoshop document", "Images", "Photoshop", true},
+    {0, "SQLite format 3\0"sv, "SQLite database", "Data", "Databases", true},
+    {0, "7z\xbc\xaf\x27\x1c"sv, "7-Zip archive", "Archives", "7z", true},
+    {0, "Rar!\x1a\x07"sv, "RAR archive", "Archives", "RAR", true},
+    {0, "\x1f\x8b"sv, "gzip archive", "Archives", "Compressed", true},
+    {0, "\xfd" "7zXZ\0"sv, "xz archive", "Archives", "Compressed", true},
+    {0, "BZh"sv, "bzip2 archive", "Archives", "Compressed", false},
+    {0, "\x28\xb5\x2f\xfd"sv, "Zstandard archive", "Archives", "Compressed", true},
+    {257, "ustar"sv, "tar archive", "Archives", "Tar", true},
+    {0, "ID3"sv, "MP3 audio", "Music", "MP3", true},
+    {0, "fLaC"sv, "FLAC audio", "Music", "FLAC", true},
+    {0, "OggS"sv, "Ogg media", "Music", "Ogg", false},
+    {0, "MThd"sv, "MIDI audio", "Music", "MIDI", true},
+    {0, "\x1a\x45\xdf\xa3"sv, "Matroska/WebM video", "Videos", "MKV", true},
+    {0, "FLV\x01"sv, "Flash video", "Videos", "FLV", true},
+    {0, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1"sv,
+        "OLE compound document (legacy Office document or MSI installer)", "Documents", "Office", false},
+    {0, "{\\rtf"sv, "RTF document", "Documents", "Text Documents", true},
+    {0, "wOFF"sv, "WOFF font", "Fonts", "Web Fonts", true},
+    {0, "wOF2"sv, "WOFF2 font", "Fonts", "Web Fonts", true},
+    {0, "OTTO"sv, "OpenType font", "Fonts", "OpenType", true},
+    {0, "\x00\x01\x00\x00\x00"sv, "TrueType font", "Fonts", "TrueType", false},
+    {0, "-----BEGIN "sv, "PEM certificate or key", "Security", "Certificates", false},
+    {0, "#!"sv, "script", "Code", "Scripts", false},
+    {0, "<?xml"sv, "XML document", "Documents", "XML", false},
+};
+
+
+bool starts_with_at(std::string_view data, size_t offset, std::string_view magic)
+{
+    return data.size() >= offset + magic.size() && data.substr(offset, magic.size()) == magic;
+}
+
+
+uint32_t read_le32(std::string_view data, size_t offset)
+{
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data.data() + offset);
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+
+ContentSniffer::Result make_result(const char* description, const char* category,
+                                   const char* subcategory, bool is_confident)
+{
+    return ContentSniffer::Result{description, Categorization{category, subcategory}, is_confident};
+}
+
+}
+
+
+/**
+ * @brief Identifies the type of a file from the first bytes of its contents.
+ *
+ * Only the first few KB of the file are mapped, so the cost does not depend
+ * on the size of the file.
+ *
+ * @param path The file to inspect.
+ * @return The detected type, or std::nullopt if the file cannot be read or its type is unknown.
+ */
+std::optional<ContentSniffer::Result> ContentSniffer::sniff(const std::string &path)
+{
+    MappedFile file(path, header_size);
+    if (!file.is_open()) {
+        return std::nullopt;
+    }
+    return identify(file.view());
+}
+
+
+/**
+ * @brief Identifies the type of a file from its first bytes.
+ *
+ * @param header The beginning of the file.
+ * @return The detected type with a suggested categorization, or std::nullopt if
+ *         no signature matches. is_confident is false for signatures shared by
+ *         several kinds of files, whose suggestion should only serve as a hint.
+ */
+std::optional<ContentSniffer::Result> ContentSniffer::identify(std::string_view header)
+{
+    if (starts_with_at(header, 0, "PK\x03\x04"sv)) {
+        return identify_zip(header);
+    }
+    if (starts_with_at(header, 4, "ftyp"sv)) {
+        return identify_iso_media(header);
+    }
+    if (starts_with_at(header, 0, "RIFF"sv)) {
+        return identify_riff(header);
+    }
+    if (auto executable = identify_executable(header)) {
+        return executable;
+    }
+
+    for (const auto &signature : SIGNATURES) {
+        if (starts_with_at(header, signature.offset, signature.magic)) {
+            return make_result(signature.description, signature.category,
+                               signature.subcategory, signature.is_confident);
+        }
+    }
+
+    return std::nullopt;
+}
+
+
+/**
+ * @brief Tells apart the ZIP based formats by the names of their first entries.
+ */
+std::optional<ContentSniffer::Result> ContentSniffer::identify_zip(std::string_view header)
+{
+    auto contains = [header](std::string_view text) { return header.find(text) != std::string_view::npos; };
+
+    if (starts_with_at(header, 30, "mimetypeapplication/epub+zip"sv)) {
+        return make_result("EPUB e-book", "Books", "E-books", true);
+    }
+    if (starts_with_at(header, 30, "mimetypeapplication/vnd.oasis.opendocument"sv)) {
+        return make_result("OpenDocument file", "Documents", "OpenDocument", true);
+    }
+    if (contains("[Content_Types].xml"sv) || contains("_rels/.rels"sv)) {
+        if (contains("word/"sv)) {
+            return make_result("Word document", "Documents", "Word Documents", true);
+        }
+        if (contains("xl/"sv)) {
+            return make_result("Excel spreadsheet", "Documents", "Spreadsheets", true);
+        }
+        if (contains("ppt/"sv)) {
+            return make_result("PowerPoint presentation", "Documents", "Presentations", true);
+        }
+        return make_result("Office Open XML document", "Documents", "Office", false);
+    }
+    if (contains("AndroidManifest.xml"sv) || contains("classes.dex"sv)) {
+        return make_result("Android application package", "Software", "Android Apps", true);
+    }
+    if (contains("META-INF/"sv)) {
+        return make_result("Java archive", "Software", "Java", false);
+    }
+    return make_result("ZIP archive", "Archives", "ZIP", true);
+}
+
+
+/**
+ * @brief Tells apart the ISO base media formats (MP4, MOV, HEIC, ...) by their major brand.
+ */
+std::optional<ContentSniffer::Result> ContentSniffer::identify_iso_media(std::string_view header)
+{
+    if (header.size() < 12) {
+        return std::nullopt;
+    }
+
+    const std::string_view brand = header.substr(8, 4);
+    if (brand == "heic"sv || brand == "heix"sv || brand == "heim"sv || brand == "heis"sv || brand == "mif1"sv) {
+        return make_result("HEIC image", "Images", "Photos", true);
+    }
+    if (brand == "avif"sv) {
+        return make_result("AVIF image", "Images", "AVIF", true);
+    }
+    if (brand == "M4A "sv || brand == "M4B "sv) {
+        return make_result("MPEG-4 audio", "Music", "M4A", true);
+    }
+    if (brand == "qt  "sv) {
+        return make_result("QuickTime video", "Videos", "MOV", true);
+    }
+    if (brand.substr(0, 3) == "3gp"sv) {
+        return make_result("3GP video", "Videos", "3GP", true);
+    }
+    return make_result("MPEG-4 video", "Videos", "MP4", true);
+}
+
+
+/**
+ * @brief Tells apart the RIFF based formats by their form type.
+ */
+std::optional<ContentSniffer::Result> ContentSniffer::identify_riff(std::string_view header)
+{
+    if (starts_with_at(header, 8, "WAVE"sv)) {
+        return make_result("WAV audio", "Music", "WAV", true);
+    }
+    if (starts_with_at(header, 8, "AVI "sv)) {
+        return make_result("AVI video", "Videos", "AVI", true);
+    }
+    if (starts_with_at(header, 8, "WEBP"sv)) {
+        return make_result("WebP image", "Images", "WebP", true);
+    }
+    return std::nullopt;
+}
+
+
+/**
+ * @brief Identifies ELF, PE and Mach-O executables.
+ *
+ * A PE file is only reported confidently when the PE header that the MZ stub
+ * points to is within the inspected bytes.
+ */
+std::optional<ContentSniffer::Result> ContentSniffer::identify_executable(std::string_view header)
+{
+    if (starts_with_at(header, 0, "\x7f" "ELF"sv)) {
+        return make_result("Linux executable", "Software", "Linux Applications", true);
+    }
+
+    if (starts_with_at(header, 0, "\xcf\xfa\xed\xfe"sv) || starts_with_at(header, 0, "\xce\xfa\xed\xfe"sv) ||
+        starts_with_at(header, 0, "\xca\xfe\xba\xbe"sv)) {
+        return make_result("macOS executable", "Software", "macOS Applications", true);
+    }
+
+    if (starts_with_at(header, 0, "MZ"sv)) {
+        if (header.size() >= 0x40) {
+            const uint32_t pe_offset = read_le32(header, 0x3c);
+            if (starts_with_at(header, pe_offset, "PE\0\0"sv)) {
+                return make_result("Windows executable", "Software", "Windows Applications", true);
+            }
+        }
+        return make_result("DOS/Windows executable", "Software", "Windows Applications", false);
+    }
+
+    return std::nullopt;
+}
+
+
+/**
+ * @brief Tells whether a file name carries an extension that already identifies its type.
+ *
+ * Names such as "scan0001", "download" or "file (3)" do not, so the type
+ * detected from the contents is trusted for them.
+ *
+ * @param file_name The file name.
+ * @return true if the name ends with a short alphanumeric extension containing a letter.
+ */
+bool ContentSniffer::has_informative_extension(const std::string &file_name)
+{
+    const size_t dot = file_name.rfind('.');
+    if (dot == std::string::npos || dot == 0 || dot + 1 == file_name.size()) {
+        return false;
+    }
+
+    const std::string extension = file_name.substr(dot + 1);
+    if (extension.size() > 5) {
+        return false;
+    }
+
+    bool has_alpha = false;
+    for (unsigned char c : extension) {
+        if (!std::isalnum(c)) {
+            return false;
+        }
+        has_alpha = has_alpha || std::isalpha(c);
+    }
+    return has_alpha;
+}
@@ -1,15 +1,53 @@
 #include "DatabaseManager.hpp"
+#include "NameTemplate.hpp"
 #include "Settings.hpp"
+#include <chrono>
 #include <iostream>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <sqlite3.h>
+#include <thread>
 #include <unistd.h>
 #include <glib.h>
 #include <Types.hpp>
 
 
+// Queued entries the LLM failed to answer this many times are given up on
+static constexpr int MAX_PENDING_ATTEMPTS = 5;
+
+// The writer commits at most this many queued writes in one transaction
+static constexpr size_t MAX_WRITE_GROUP = 256;
+
+// Read connections kept open between reads
+static constexpr size_t MAX_IDLE_READERS = 4;
+
+// Rows of files that are gone are kept this long after their last update, for name lookups
+static const char *STALE_ROW_RETENTION = "-90 days";
+
+// Maintenance checks this many rows against the filesystem between two pauses
+static constexpr size_t MAINTENANCE_BATCH_SIZE = 256;
+static constexpr std::chrono::milliseconds MAINTENANCE_PAUSE{50};
+
+// Compaction releases at most this many free pages per step
+static constexpr int MAINTENANCE_VACUUM_STEP_PAGES = 1024;
+
+// Records a confirmed categorization under the template key of a name
+static const char *NAME_TEMPLATE_UPSERT_SQL = R"(
+    INSERT INTO file_name_templates (template_key, file_type, category, subcategory)
+    VALUES (?, ?, ?, ?)
+    ON CONFLICT(template_key, file_type)
+    DO UPDATE SET
+        sample_count = CASE
+            WHEN category = excluded.category AND IFNULL(subcategory, '') = IFNULL(excluded.subcategory, '')
+            THEN sample_count + 1 ELSE 1 END,
+        category = excluded.category,
+        subcategory = excluded.subcategory,
+        timestamp = CURRENT_TIMESTAMP;
+)";
+
+
 /**
  * Constructs a DatabaseManager object and initializes the SQLite database.
  * 
@@ -19,10 +57,25 @@
  * If the environment variable "CATEGORIZATION_CACHE_FILE" is set, it uses its value
  * as the database file name; otherwise, defaults to "categorization_results.db".
  * If the database file path is empty or the database cannot be opened, an error
- * message is printed. Ensures that the 'file_categorization' table exists in the
- * database, creating it if necessary, with columns for file name, type, directory path,
- * category, subcategory, and a timestamp, with a unique constraint on file name, type,
- * and directory path.
+ * message is printed. The connection is tuned by configure_connection(), and the
+ * schema is created or upgraded by run_migrations(). The 'file_categorization'
+ * table holds the file name, type, directory, category, subcategory, and a timestamp
+ * of every entry, with a unique constraint on directory, file name and type. The
+ * directory paths are interned in the 'directories' table, which file_categorization
+ * references through its dir_id column. The 'file_name_templates' table maps the template key of a
+ * name (see NameTemplate) to the categorization last confirmed for it. Category
+ * and subcategory names are interned in the 'category_vocabulary' table, which
+ * file_categorization references through its category_id and subcategory_id columns.
+ * The 'pending_categorization' table queues the entries that could not be sent
+ * to the LLM, until they are categorized in the background. Finally the local
+ * name classifier is trained from the stored categorizations, and the
+ * in-memory categorization cache starts loading in the background.
+ *
+ * After construction, the connection opened here belongs to the writer
+ * thread, which carries out every write (see submit_write). Reads go through
+ * pooled read-only connections (see reader), which WAL lets
+ * proceed while the writer commits, so the analysis thread, the queue drain
+ * and the GTK thread can all use the DatabaseManager at the same time.
  */
 
 DatabaseManager::DatabaseManager(std::string config_dir) :
@@ -42,6 +95,130 @@ DatabaseManager::DatabaseManager(std::string config_dir) :
         return;
     }
 
+    configure_connection(db, true);
+    statements.attach(db);
+
+    if (!run_migrations()) {
+        return;
+    }
+
+    load_vocabulary();
+    backfill_vocabulary_ids();
+    backfill_name_templates();
+    train_classifier();
+    cache.start_loading(db_file, config_dir + "/categorization_cache.bin");
+    writer = std::thread(&DatabaseManager::run_writer, this);
+}
+
+
+/**
+ * Tunes a connection for many small lookups and batched writes.
+ *
+ * New databases are created with incremental auto-vacuum, so that maintenance
+ * can return the pages of pruned rows to the file system (see compact_database).
+ * WAL lets readers proceed while a batch is written, and with synchronous=NORMAL
+ * a commit no longer waits for an fsync; only the last transactions before a
+ * power loss can be lost, never the consistency of the database. Reads go
+ * through a 256 MB memory map and a 16 MB page cache, and a locked database is
+ * retried for up to 5 seconds instead of failing at once.
+ *
+ * @param connection The connection to configure.
+ * @param writable true for the write connection, which also switches the database to WAL.
+ */
+void DatabaseManager::configure_connection(sqlite3* connection, bool writable)
+{
+    sqlite3_busy_timeout(connection, 5000);
+
+    const char* write_pragmas = R"(
+        PRAGMA auto_vacuum = INCREMENTAL;
+        PRAGMA journal_mode = WAL;
+        PRAGMA synchronous = NORMAL;
+    )";
+    const char* pragmas = R"(
+        PRAGMA temp_store = MEMORY;
+        PRAGMA mmap_size = 268435456;
+        PRAGMA cache_size = -16384;
+    )";
+
+    char* error_msg = nullptr;
+    if ((writable && sqlite3_exec(connection, write_pragmas, nullptr, nullptr, &error_msg) != SQLITE_OK) ||
+        sqlite3_exec(connection, pragmas, nullptr, nullptr, &error_msg) != SQLITE_OK) {
+        std::cerr << "Failed to configure the database connection: " << error_msg << std::endl;
+        sqlite3_free(error_msg);
+    }
+}
+
+
+/**
+ * Brings the schema up to date, one migration at a time.
+ *
+ * The schema version is kept in PRAGMA user_version. Every migration newer than
+ * the stored version runs in its own transaction together with the version bump,
+ * so an interrupted upgrade resumes at the migration that failed. Databases
+ * created before the version was tracked report version 0 and go through every
+ * migration, which is why the first one only creates what is missing.
+ *
+ * @return true if the schema is current, false if a migration failed.
+ */
+bool DatabaseManager::run_migrations()
+{
+    struct Migration {
+        int version;
+        const char* description;
+        bool (DatabaseManager::*apply)();
+    };
+    static const Migration migrations[] = {
+        {1, "create the base schema", &DatabaseManager::create_base_schema},
+        {2, "intern directory paths", &DatabaseManager::intern_directory_paths},
+        {3, "track the cache generation", &DatabaseManager::track_cache_generation},
+        {4, "store file fingerprints", &DatabaseManager::create_fingerprint_table},
+        {5, "flag unconfirmed categorizations", &DatabaseManager::add_confirmed_flag},
+    };
+    const int latest_version = migrations[std::size(migrations) - 1].version;
+
+    int version = 0;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (version > latest_version) {
+        std::cerr << "Database schema version " << version << " is newer than the supported version "
+                  << latest_version << "; the database is used as is." << std::endl;
+        return true;
+    }
+
+    for (const auto& migration : migrations) {
+        if (migration.version <= version) {
+            continue;
+        }
+
+        sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+        const std::string bump_sql = "PRAGMA user_version = " + std::to_string(migration.version) + ";";
+        if (!(this->*migration.apply)() ||
+            sqlite3_exec(db, bump_sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK ||
+            sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            std::cerr << "Failed to migrate the database to version " << migration.version
+                      << " (" << migration.description << "): " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+            return false;
+        }
+        version = migration.version;
+    }
+
+    return true;
+}
+
+
+/**
+ * Migration 1: creates the tables of the schema as it was before migrations
+ * were versioned, and adds the vocabulary id columns to older databases.
+ */
+bool DatabaseManager::create_base_schema()
+{
     const char* create_table_sql = R"(
         CREATE TABLE IF NOT EXISTS file_categorization (
             id INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -53,180 +230,2028 @@ DatabaseManager::DatabaseManager(std::string config_dir) :
             timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
             UNIQUE(file_name, file_type, dir_path)
         );
+
+        CREATE TABLE IF NOT EXISTS file_name_templates (
+            template_key TEXT NOT NULL,
+            file_type TEXT NOT NULL,
+            category TEXT NOT NULL,
+            subcategory TEXT,
+            sample_count INTEGER NOT NULL DEFAULT 1,
+            timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
+            PRIMARY KEY(template_key, file_type)
+        ) WITHOUT ROWID;
+
+        CREATE TABLE IF NOT EXISTS category_vocabulary (
+            id INTEGER PRIMARY KEY,
+            parent_id INTEGER NOT NULL DEFAULT 0,
+            name TEXT NOT NULL,
+            use_count INTEGER NOT NULL DEFAULT 0,
+            UNIQUE(parent_id, name)
+        );
+
+        CREATE TABLE IF NOT EXISTS pending_categorization (
+            file_name TEXT NOT NULL,
+            file_type TEXT NOT NULL,
+            dir_path TEXT NOT NULL,
+            full_path TEXT NOT NULL,
+            content_type TEXT,
+            attempts INTEGER NOT NULL DEFAULT 0,
+            queued_at DATETIME DEFAULT CURRENT_TIMESTAMP,
+            PRIMARY KEY(file_name, file_type, dir_path)
+        ) WITHOUT ROWID;
     )";
 
     char* error_msg = nullptr;
     if (sqlite3_exec(db, create_table_sql, nullptr, nullptr, &error_msg) != SQLITE_OK) {
         std::cerr << "Failed to create table: " << error_msg << std::endl;
         sqlite3_free(error_msg);
+        return false;
     }
+
+    return ensure_vocabulary_columns();
 }
 
 
 /**
- * Destructor for the DatabaseManager class.
+ * Migration 2: moves the directory paths of 'file_categorization' into the
+ * 'directories' table.
  *
- * Closes the SQLite database connection if it is open to ensure
- * proper resource management and to prevent memory leaks.
+ * Every distinct path is stored once and the rows reference it by id, which
+ * keeps databases with millions of rows small. The table is rebuilt with its
+ * unique key leading on dir_id, so listing a folder is an index range scan, and
+ * a separate index on file name and type serves the lookups by name.
  */
+bool DatabaseManager::intern_directory_paths()
+{
+    const char* migrate_sql = R"(
+        CREATE TABLE directories (
+            id INTEGER PRIMARY KEY,
+            path TEXT NOT NULL UNIQUE
+        );
 
-DatabaseManager::~DatabaseManager() {
-    if (db) {
-        sqlite3_close(db);
+        INSERT INTO directories (path)
+        SELECT DISTINCT dir_path FROM file_categorization ORDER BY dir_path;
+
+        CREATE TABLE file_categorization_new (
+            id INTEGER PRIMARY KEY AUTOINCREMENT,
+            dir_id INTEGER NOT NULL REFERENCES directories(id),
+            file_name TEXT NOT NULL,
+            file_type TEXT NOT NULL,
+            category TEXT NOT NULL,
+            subcategory TEXT,
+            category_id INTEGER REFERENCES category_vocabulary(id),
+            subcategory_id INTEGER REFERENCES category_vocabulary(id),
+            timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,
+            UNIQUE(dir_id, file_name, file_type)
+        );
+
+        INSERT INTO file_categorization_new (id, dir_id, file_name, file_type, category, subcategory,
+                                             category_id, subcategory_id, timestamp)
+        SELECT f.id, d.id, f.file_name, f.file_type, f.category, f.subcategory,
+               f.category_id, f.subcategory_id, f.timestamp
+        FROM file_categorization f JOIN directories d ON d.path = f.dir_path
+        ORDER BY d.id, f.file_name;
+
+        DROP TABLE file_categorization;
+        ALTER TABLE file_categorization_new RENAME TO file_categorization;
+
+        CREATE INDEX idx_file_categorization_name ON file_categorization (file_name, file_type);
+    )";
+
+    char* error_msg = nullptr;
+    if (sqlite3_exec(db, migrate_sql, nullptr, nullptr, &error_msg) != SQLITE_OK) {
+        std::cerr << "Failed to intern directory paths: " << error_msg << std::endl;
+        sqlite3_free(error_msg);
+        return false;
     }
+
+    return true;
 }
 
 
 /**
- * Inserts a new entry into the database or updates an existing entry if it already exists.
- *
- * @param file_name The name of the file or directory to be categorized.
- * @param file_type The type of file, either FileType::File or FileType::Directory.
- * @param dir_path The directory path where the file or directory is located.
- * @param category The top-level category assigned to the file or directory.
- * @param subcategory The subcategory assigned to the file or directory.
- *
- * @return true if the operation was successful, false otherwise.
+ * Migration 3: adds the 'cache_state' table, whose generation is bumped by
+ * every transaction that changes 'file_categorization' (see bump_cache_generation),
+ * so a saved CategorizationCache snapshot is only reused while it is current.
  */
-bool DatabaseManager::insert_or_update_file_with_categorization(const std::string& file_name,
-                                                                const std::string& file_type,
-                                                                const std::string& dir_path, 
-                                                                const std::string& category, 
-                                                                const std::string& subcategory) {
-    const char *sql = R"(
-        INSERT INTO file_categorization (file_name, file_type, dir_path, category, subcategory)
-        VALUES (?, ?, ?, ?, ?)
-        ON CONFLICT(file_name, file_type, dir_path)
-        DO UPDATE SET category = excluded.category, subcategory = excluded.subcategory;
+bool DatabaseManager::track_cache_generation()
+{
+    const char* migrate_sql = R"(
+        CREATE TABLE cache_state (
+            id INTEGER PRIMARY KEY CHECK (id = 1),
+            generation INTEGER NOT NULL
+        );
+        INSERT INTO cache_state (id, generation) VALUES (1, 0);
     )";
-    sqlite3_stmt *stmt;
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+    char* error_msg = nullptr;
+    if (sqlite3_exec(db, migrate_sql, nullptr, nullptr, &error_msg) != SQLITE_OK) {
+        std::cerr << "Failed to add the cache generation: " << error_msg << std::endl;
+        sqlite3_free(error_msg);
         return false;
     }
 
-    sqlite3_bind_text(stmt, 1, file_name.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, file_type.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, dir_path.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 4, category.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 5, subcategory.c_str(), -1, SQLITE_STATIC);
+    return true;
+}
 
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        g_print("SQL error during insert or update: %s\n", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
+
+/**
+ * Migration 4: adds the 'file_fingerprints' table.
+ *
+ * It holds the size, modification time and sampled content hash of the files
+ * seen while scanning, keyed like 'file_categorization' by directory and name.
+ * Kept apart from the categorizations, it also covers files that were scanned
+ * before being categorized, and it is indexed by content so that a renamed or
+ * moved copy of a categorized file is found by its contents.
+ */
+bool DatabaseManager::create_fingerprint_table()
+{
+    const char* migrate_sql = R"(
+        CREATE TABLE file_fingerprints (
+            dir_id INTEGER NOT NULL REFERENCES directories(id),
+            file_name TEXT NOT NULL,
+            file_size INTEGER NOT NULL,
+            file_mtime INTEGER NOT NULL,
+            content_hash INTEGER NOT NULL,
+            PRIMARY KEY(dir_id, file_name)
+        ) WITHOUT ROWID;
+
+        CREATE INDEX idx_file_fingerprints_content ON file_fingerprints (content_hash, file_size);
+    )";
+
+    char* error_msg = nullptr;
+    if (sqlite3_exec(db, migrate_sql, nullptr, nullptr, &error_msg) != SQLITE_OK) {
+        std::cerr << "Failed to add the fingerprint table: " << error_msg << std::endl;
+        sqlite3_free(error_msg);
         return false;
     }
 
-    sqlite3_finalize(stmt);
     return true;
 }
 
 
 /**
- * Retrieves a list of categorized files from the database for a given directory path.
+ * Migration 5: adds the 'confirmed' flag to 'file_categorization'.
  *
- * @param directory_path The directory path to filter categorized files by.
- * 
- * @return A vector of CategorizedFile objects, each containing metadata such as directory path,
- *         file name, file type, category, and subcategory.
+ * Rows written before are all confirmed by the user. Answers of the pending
+ * queue drain are stored unconfirmed: they are shown for review on the next
+ * analysis of their folder, but nothing learns from them until confirmed.
+ */
+bool DatabaseManager::add_confirmed_flag()
+{
+    const char* migrate_sql = "ALTER TABLE file_categorization ADD COLUMN confirmed INTEGER NOT NULL DEFAULT 1;";
+
+    char* error_msg = nullptr;
+    if (sqlite3_exec(db, migrate_sql, nullptr, nullptr, &error_msg) != SQLITE_OK) {
+        std::cerr << "Failed to add the confirmed flag: " << error_msg << std::endl;
+        sqlite3_free(error_msg);
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Marks 'file_categorization' as changed, within the caller's transaction.
  *
- * This function executes an SQL query to select categorized files from the 'file_categorization'
- * table where the directory path matches the specified parameter. If the directory path cannot
- * be bound or the query preparation fails, an empty vector is returned. The query results
- * are transformed into CategorizedFile objects which are then collected into a vector.
+ * Bumping once per transaction rather than per row, e.g. from a trigger,
+ * keeps bulk writes cheap.
  */
+bool DatabaseManager::bump_cache_generation()
+{
+    auto stmt = statements.acquire("UPDATE cache_state SET generation = generation + 1;");
+    return stmt && sqlite3_step(stmt.get()) == SQLITE_DONE;
+}
 
-std::vector<CategorizedFile>
-DatabaseManager::get_categorized_files(const std::string& directory_path)
+
+/**
+ * Retrieves the generation of 'file_categorization', or -1 if it is unknown.
+ */
+int64_t DatabaseManager::get_cache_generation()
 {
-    std::vector<CategorizedFile> categorized_files;
-    const char *sql = "SELECT dir_path, file_name, file_type, category, subcategory FROM file_categorization WHERE dir_path=?;";
-    sqlite3_stmt *stmtcat;
+    auto stmt = statements.acquire("SELECT generation FROM cache_state;");
+    if (!stmt || sqlite3_step(stmt.get()) != SQLITE_ROW) {
+        return -1;
+    }
+    return sqlite3_column_int64(stmt.get(), 0);
+}
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmtcat, nullptr) != SQLITE_OK) {
-        // g_print("SQL error: %s\n", sqlite3_errmsg(db));
-        return categorized_files;
+
+/**
+ * Checks whether a table has a column, for upgrading databases created by older versions.
+ */
+bool DatabaseManager::has_column(const std::string& table, const std::string& column)
+{
+    const std::string sql = "PRAGMA table_info(" + table + ");";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
     }
 
-    if (sqlite3_bind_text(stmtcat, 1, directory_path.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
-        std::cerr << "Failed to bind directory_path: " << sqlite3_errmsg(db) << std::endl;
-        return categorized_files;
+    bool found = false;
+    while (!found && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        found = name && column == name;
     }
 
-    int rc;
-    while ((rc = sqlite3_step(stmtcat)) == SQLITE_ROW) {
-        const char* file_dir_path = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 0));
-        const char* file_name = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 1));
-        const char* file_type = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 2));
-        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 3));
-        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 4));
+    sqlite3_finalize(stmt);
+    return found;
+}
 
-        // Ensure null safety for strings
-        std::string dir_path = file_dir_path ? file_dir_path : "";
-        std::string name = file_name ? file_name : "";
-        std::string type_str = file_type ? file_type : "";
-        std::string cat = category ? category : "";
-        std::string subcat = subcategory ? subcategory : "";
 
-        FileType file_type_enum = (type_str == "F") ? FileType::File : FileType::Directory;
+/**
+ * Adds the vocabulary id columns to a 'file_categorization' table that lacks them.
+ */
+bool DatabaseManager::ensure_vocabulary_columns()
+{
+    for (const char* column : {"category_id", "subcategory_id"}) {
+        if (has_column("file_categorization", column)) {
+            continue;
+        }
 
-        categorized_files.push_back({dir_path, name, file_type_enum, cat, subcat});
+        const std::string sql = std::string("ALTER TABLE file_categorization ADD COLUMN ") + column +
+                                " INTEGER REFERENCES category_vocabulary(id);";
+        char* error_msg = nullptr;
+        if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error_msg) != SQLITE_OK) {
+            std::cerr << "Failed to add column " << column << ": " << error_msg << std::endl;
+            sqlite3_free(error_msg);
+            return false;
+        }
     }
 
-    sqlite3_finalize(stmtcat);
+    return true;
+}
 
-    return categorized_files;
+
+/**
+ * Loads the 'category_vocabulary' table into memory.
+ */
+void DatabaseManager::load_vocabulary()
+{
+    const char *sql = "SELECT id, parent_id, name, use_count FROM category_vocabulary;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+        return;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        vocabulary.add({sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1),
+                        name ? name : "", static_cast<long>(sqlite3_column_int64(stmt, 3))});
+    }
+
+    sqlite3_finalize(stmt);
 }
 
 
 /**
- * Retrieves the categorization of a file from the database.
- *
- * @param file_name The name of the file to query.
- * @param file_type The type of the file to query (file or directory).
+ * Interns the categories of rows stored before the vocabulary existed.
  *
- * @return A vector of two strings, where the first element is the category and the second element is the subcategory.
- *         If the query fails or the file does not exist in the database, an empty vector is returned.
+ * Rows whose category_id is not set yet are grouped by category and
+ * subcategory, and every group is interned once, counting one use per row.
  */
-std::vector<std::string>
-DatabaseManager::get_categorization_from_db(const std::string& file_name, const FileType file_type)
+void DatabaseManager::backfill_vocabulary_ids()
 {
-    std::vector<std::string> categorization;
-    const char *sql = "SELECT category, subcategory FROM file_categorization WHERE file_name = ? AND file_type = ?;";
-    sqlite3_stmt *stmtcat;
+    struct Group {
+        std::string category;
+        std::string subcategory;
+        bool has_subcategory;
+        long rows;
+    };
+    std::vector<Group> groups;
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmtcat, nullptr) != SQLITE_OK) {
+    const char *select_sql = R"(
+        SELECT category, subcategory, COUNT(*) FROM file_categorization
+        WHERE category_id IS NULL GROUP BY category, subcategory;
+    )";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, select_sql, -1, &stmt, nullptr) != SQLITE_OK) {
         g_print("SQL error: %s\n", sqlite3_errmsg(db));
-        return categorization;
+        return;
     }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        groups.push_back({category ? category : "", subcategory ? subcategory : "",
+                          subcategory != nullptr, static_cast<long>(sqlite3_column_int64(stmt, 2))});
+    }
+    sqlite3_finalize(stmt);
 
-    if (sqlite3_bind_text(stmtcat, 1, file_name.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
-        std::cerr << "Failed to bind file_name: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmtcat);
-        return categorization;
+    if (groups.empty()) {
+        return;
     }
 
-    std::string file_type_str = (file_type == FileType::File) ? "F" : "D";
+    const char *update_sql = R"(
+        UPDATE file_categorization SET category_id = ?, subcategory_id = ?
+        WHERE category_id IS NULL AND category = ? AND subcategory IS ?;
+    )";
+    if (sqlite3_prepare_v2(db, update_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+        return;
+    }
 
-    if (sqlite3_bind_text(stmtcat, 2, file_type_str.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
-        std::cerr << "Failed to bind file_type: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmtcat);
-        return categorization;
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    bool written = true;
+    for (const auto& group : groups) {
+        const int category_id = intern_category(group.category, 0, group.rows);
+        if (category_id == 0) {
+            continue;
+        }
+        const int subcategory_id = intern_category(group.subcategory, category_id, group.rows);
+
+        sqlite3_bind_int(stmt, 1, category_id);
+        if (subcategory_id != 0) {
+            sqlite3_bind_int(stmt, 2, subcategory_id);
+        } else {
+            sqlite3_bind_null(stmt, 2);
+        }
+        sqlite3_bind_text(stmt, 3, group.category.c_str(), -1, SQLITE_STATIC);
+        if (group.has_subcategory) {
+            sqlite3_bind_text(stmt, 4, group.subcategory.c_str(), -1, SQLITE_STATIC);
+        } else {
+            sqlite3_bind_null(stmt, 4);
+        }
+
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            g_print("SQL error during vocabulary backfill: %s\n", sqlite3_errmsg(db));
+        }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
     }
+    settle_vocabulary_changes(VocabularyScope::Request, true);
+    if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        g_print("SQL error while committing the vocabulary backfill: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        written = false;
+    }
+    settle_vocabulary_changes(VocabularyScope::Transaction, written);
 
-    int rc;
-    if ((rc = sqlite3_step(stmtcat)) == SQLITE_ROW) {
-        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 0));
-        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 1));
+    sqlite3_finalize(stmt);
+}
 
-        // std::cout << "Got categorization from DB: " << category << " " << subcategory << std::endl;
 
-        categorization.push_back(category ? category : "");
-        categorization.push_back(subcategory ? subcategory : "");
+/**
+ * Returns the vocabulary id of a category or subcategory, adding it if it is new.
+ *
+ * Near-synonyms of an existing name (see CategoryVocabulary::normalize) map to
+ * the existing entry. The in-memory vocabulary is not changed here: new entries
+ * and uses are collected in request_vocabulary, and reach the vocabulary only
+ * once the transaction that wrote them is committed (see settle_vocabulary_changes),
+ * so a rolled back write leaves no ids behind that the database does not have.
+ *
+ * @param name The category or subcategory name.
+ * @param parent_id 0 for a category, or the id of the category of a subcategory.
+ * @param uses The number of uses to add to the entry.
+ *
+ * @return The id of the entry, or 0 if the name is empty or cannot be stored.
+ */
+int DatabaseManager::intern_category(const std::string& name, int parent_id, long uses)
+{
+    if (CategoryVocabulary::normalize(name).empty()) {
+        return 0;
     }
 
-    sqlite3_finalize(stmtcat);
+    int id = request_vocabulary.find(name, parent_id);
+    if (id == 0) {
+        id = transaction_vocabulary.find(name, parent_id);
+    }
+    if (id == 0) {
+        id = vocabulary.find(name, parent_id);
+    }
 
-    return categorization;
-}
\ No newline at end of file
+    if (id != 0) {
+        auto stmt = statements.acquire("UPDATE category_vocabulary SET use_count = use_count + ? WHERE id = ?;");
+        if (!stmt) {
+            return 0;
+        }
+        sqlite3_bind_int64(stmt.get(), 1, uses);
+        sqlite3_bind_int(stmt.get(), 2, id);
+        if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+            g_print("SQL error while counting a vocabulary use: %s\n", sqlite3_errmsg(db));
+            return 0;
+        }
+        if (request_vocabulary.find(name, parent_id) == 0) {
+            request_vocabulary.add({id, parent_id, name, 0});
+        }
+        request_vocabulary.add_use(id, uses);
+        return id;
+    }
+
+    auto stmt = statements.acquire("INSERT INTO category_vocabulary (parent_id, name, use_count) VALUES (?, ?, ?);");
+    if (!stmt) {
+        return 0;
+    }
+
+    sqlite3_bind_int(stmt.get(), 1, parent_id);
+    sqlite3_bind_text(stmt.get(), 2, name.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt.get(), 3, uses);
+
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+        g_print("SQL error while adding to the vocabulary: %s\n", sqlite3_errmsg(db));
+        return 0;
+    }
+
+    id = static_cast<int>(sqlite3_last_insert_rowid(db));
+    request_vocabulary.add({id, parent_id, name, uses});
+    return id;
+}
+
+
+/**
+ * Settles the vocabulary changes collected by intern_category.
+ *
+ * @param scope Request when the write that made the changes was applied or rolled
+ *              back; Transaction when the transaction was committed or rolled back.
+ * @param kept true to keep the changes, false to drop them.
+ */
+void DatabaseManager::settle_vocabulary_changes(VocabularyScope scope, bool kept)
+{
+    if (scope == VocabularyScope::Request) {
+        if (kept) {
+            transaction_vocabulary.merge(request_vocabulary);
+        }
+        request_vocabulary.clear();
+        return;
+    }
+
+    if (kept) {
+        vocabulary.merge(transaction_vocabulary);
+    }
+    transaction_vocabulary.clear();
+}
+
+
+/**
+ * Retrieves the in-memory category vocabulary.
+ */
+const CategoryVocabulary& DatabaseManager::get_vocabulary() const
+{
+    return vocabulary;
+}
+
+
+/**
+ * Trains the local name classifier from every row of 'file_categorization'.
+ */
+void DatabaseManager::train_classifier()
+{
+    const char *sql = "SELECT file_name, file_type, category, subcategory FROM file_categorization WHERE confirmed = 1;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+        return;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* file_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* file_type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        if (!file_name || !category) {
+            continue;
+        }
+        classifier.learn(file_name,
+                         file_type && std::string(file_type) == "D" ? FileType::Directory : FileType::File,
+                         {category, subcategory ? subcategory : ""});
+    }
+
+    sqlite3_finalize(stmt);
+}
+
+
+/**
+ * Retrieves the local classifier trained from the stored categorizations.
+ */
+const NameClassifier& DatabaseManager::get_classifier() const
+{
+    return classifier;
+}
+
+
+/**
+ * Fills the 'file_name_templates' table from the existing categorizations.
+ *
+ * Runs only while the table is empty, i.e. once for databases created before
+ * the table existed. Older entries are replayed first, so the most recent
+ * categorization of a template wins, as it does for new entries.
+ */
+void DatabaseManager::backfill_name_templates()
+{
+    sqlite3_stmt *stmt;
+    const char *count_sql = "SELECT EXISTS(SELECT 1 FROM file_name_templates);";
+    if (sqlite3_prepare_v2(db, count_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return;
+    }
+    bool has_templates = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) != 0;
+    sqlite3_finalize(stmt);
+    if (has_templates) {
+        return;
+    }
+
+    const char *select_sql = R"(
+        SELECT file_name, file_type, category, subcategory FROM file_categorization
+        WHERE confirmed = 1 ORDER BY timestamp, id;
+    )";
+    if (sqlite3_prepare_v2(db, select_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+        return;
+    }
+
+    sqlite3_stmt *template_stmt;
+    if (sqlite3_prepare_v2(db, NAME_TEMPLATE_UPSERT_SQL, -1, &template_stmt, nullptr) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+        return;
+    }
+
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* file_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        const char* file_type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+
+        update_name_template(template_stmt, file_name ? file_name : "", file_type ? file_type : "",
+                             category ? category : "", subcategory ? subcategory : "");
+    }
+    sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+
+    sqlite3_finalize(template_stmt);
+    sqlite3_finalize(stmt);
+}
+
+
+/**
+ * Destructor for the DatabaseManager class.
+ *
+ * Lets the writer thread commit the writes still queued, saves the
+ * categorization cache as a snapshot for the next start, then
+ * closes the SQLite database connections if it is open to ensure
+ * proper resource management and to prevent memory leaks.
+ */
+
+DatabaseManager::~DatabaseManager() {
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        stop_writer = true;
+    }
+    writer_wakeup.notify_one();
+    if (writer.joinable()) {
+        writer.join();
+    }
+
+    cache.stop_loading();
+    if (db && cache.is_loaded()) {
+        const int64_t generation = get_cache_generation();
+        if (generation >= 0) {
+            cache.save_snapshot(generation);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex);
+        idle_readers.clear();
+    }
+    statements.clear();
+    if (db) {
+        sqlite3_close(db);
+    }
+}
+
+
+/**
+ * Queues a write for the writer thread.
+ *
+ * The request is pushed onto a lock-free queue, so the calling thread, be it
+ * the GTK thread or an analysis worker, never waits for the database.
+ *
+ * @param apply Writes to the database within the transaction of the writer thread.
+ * @param on_commit Runs on the writer thread once the write is committed, e.g.
+ *                  to update in-memory state; may be empty.
+ *
+ * @return A future that is true once the write is committed, false if it failed.
+ */
+std::future<bool> DatabaseManager::submit_write(std::function<bool()> apply, std::function<void()> on_commit)
+{
+    WriteRequest request;
+    request.apply = std::move(apply);
+    request.on_commit = std::move(on_commit);
+    std::future<bool> done = request.done.get_future();
+
+    if (!writer.joinable()) {
+        request.done.set_value(false);
+        return done;
+    }
+
+    write_queue.push(std::move(request));
+    {
+        // Taking the lock orders the push before the writer's next check of the queue
+        std::lock_guard<std::mutex> lock(writer_mutex);
+    }
+    writer_wakeup.notify_one();
+    return done;
+}
+
+
+/**
+ * Waits until every write queued so far is committed or has failed.
+ *
+ * For readers that must see writes queued without waiting for them, e.g. an
+ * analysis started right after the categorization dialog stored its rows.
+ */
+void DatabaseManager::wait_for_writes()
+{
+    submit_write([] { return true; }).wait();
+}
+
+
+/**
+ * Carries out the queued writes until the DatabaseManager is destroyed.
+ *
+ * Whatever has piled up while the previous transaction was committed is taken
+ * from the queue and committed together, so under load many writes share one
+ * commit, while a lone write is still committed right away. Standalone
+ * requests run on their own, outside any transaction, after the writes queued
+ * before them. Writes queued before shutdown are committed before the thread exits.
+ */
+void DatabaseManager::run_writer()
+{
+    std::vector<WriteRequest> group;
+    while (true) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(writer_mutex);
+            writer_wakeup.wait(lock, [this] { return stop_writer || !write_queue.empty(); });
+            stopping = stop_writer;
+        }
+
+        WriteRequest request;
+        while (group.size() < MAX_WRITE_GROUP && write_queue.try_pop(request)) {
+            if (request.standalone) {
+                if (!group.empty()) {
+                    commit_write_group(group);
+                    group.clear();
+                }
+                request.done.set_value(request.apply());
+                continue;
+            }
+            group.push_back(std::move(request));
+        }
+        if (group.empty()) {
+            if (stopping) {
+                break;
+            }
+            continue;
+        }
+
+        commit_write_group(group);
+        group.clear();
+    }
+}
+
+
+/**
+ * Commits a group of writes in one transaction.
+ *
+ * Every write runs inside its own savepoint, so a write that fails is rolled
+ * back alone and does not take the rest of the group with it.
+ */
+void DatabaseManager::commit_write_group(std::vector<WriteRequest>& group)
+{
+    std::vector<bool> applied(group.size(), false);
+    bool committed = sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) == SQLITE_OK;
+
+    for (size_t i = 0; committed && i < group.size(); ++i) {
+        sqlite3_exec(db, "SAVEPOINT write_request;", nullptr, nullptr, nullptr);
+        applied[i] = group[i].apply();
+        if (!applied[i]) {
+            sqlite3_exec(db, "ROLLBACK TO write_request;", nullptr, nullptr, nullptr);
+        }
+        sqlite3_exec(db, "RELEASE write_request;", nullptr, nullptr, nullptr);
+        settle_vocabulary_changes(VocabularyScope::Request, applied[i]);
+    }
+
+    if (committed && sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        g_print("SQL error while committing queued writes: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        committed = false;
+    } else if (!committed) {
+        g_print("SQL error while starting queued writes: %s\n", sqlite3_errmsg(db));
+    }
+    settle_vocabulary_changes(VocabularyScope::Transaction, committed);
+
+    for (size_t i = 0; i < group.size(); ++i) {
+        const bool written = committed && applied[i];
+        if (written && group[i].on_commit) {
+            group[i].on_commit();
+        }
+        group[i].done.set_value(written);
+    }
+}
+
+
+/**
+ * Closes a read connection.
+ */
+DatabaseManager::ReadConnection::~ReadConnection()
+{
+    statements.clear();
+    if (db) {
+        sqlite3_close(db);
+    }
+}
+
+
+/**
+ * Checks a read-only connection out of the pool, opening one if none is idle.
+ *
+ * SQLite connections must not be shared between threads without locking, so
+ * every read goes through a connection no other thread uses meanwhile, with
+ * its own cache of prepared statements. The lease gives the connection back
+ * when it ends, so the number of connections follows the number of concurrent
+ * reads rather than the number of threads ever started.
+ */
+DatabaseManager::ReadLease DatabaseManager::reader()
+{
+    std::unique_ptr<ReadConnection> connection;
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex);
+        if (!idle_readers.empty()) {
+            connection = std::move(idle_readers.back());
+            idle_readers.pop_back();
+        }
+    }
+
+    if (!connection) {
+        connection = std::make_unique<ReadConnection>();
+        if (sqlite3_open_v2(db_file.c_str(), &connection->db,
+                            SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+            std::cerr << "Can't open database for reading: " << sqlite3_errmsg(connection->db) << std::endl;
+            sqlite3_close(connection->db);
+            connection->db = nullptr;
+        } else {
+            configure_connection(connection->db, false);
+        }
+        connection->statements.attach(connection->db);
+    }
+    return ReadLease(*this, std::move(connection));
+}
+
+
+/**
+ * Takes back a connection at the end of its lease.
+ *
+ * Up to MAX_IDLE_READERS connections are kept open for the next reads; the
+ * others, and connections that failed to open, are closed.
+ */
+void DatabaseManager::release_reader(std::unique_ptr<ReadConnection> connection)
+{
+    if (connection && connection->db) {
+        std::lock_guard<std::mutex> lock(readers_mutex);
+        if (idle_readers.size() < MAX_IDLE_READERS) {
+            idle_readers.push_back(std::move(connection));
+        }
+    }
+}
+
+
+/**
+ * Inserts a new entry into the database or updates an existing entry if it already exists.
+ *
+ * @param file_name The name of the file or directory to be categorized.
+ * @param file_type The type of file, either FileType::File or FileType::Directory.
+ * @param dir_path The directory path where the file or directory is located.
+ * @param category The top-level category assigned to the file or directory.
+ * @param subcategory The subcategory assigned to the file or directory.
+ *
+ * @return A future that is true once the entry was committed, false if it failed.
+ */
+std::future<bool> DatabaseManager::insert_or_update_file_with_categorization(const std::string& file_name,
+                                                                             const std::string& file_type,
+                                                                             const std::string& dir_path, 
+                                                                             const std::string& category, 
+                                                                             const std::string& subcategory) {
+    const FileType type = file_type == "D" ? FileType::Directory : FileType::File;
+    return insert_or_update_files_with_categorization({CategorizedFile{dir_path, file_name, type, category, subcategory}});
+}
+
+
+/**
+ * Queues the categorizations of many entries to be inserted or updated.
+ *
+ * The rows are written by the writer thread, usually together with other
+ * queued writes in one transaction (see commit_write_group), so the caller
+ * never waits for the disk. The statements are prepared once and reused for
+ * every row.
+ *
+ * The category and subcategory are spelled as in the vocabulary when they are
+ * near-synonyms of existing names, and new names are added to the vocabulary.
+ * Once the rows are committed, the local name classifier learns new rows and
+ * follows changed ones, so it always reflects the table, however often the
+ * same row is confirmed, and the categorization cache is updated. A row that
+ * fails is reported and skipped; the others are still written.
+ *
+ * Unconfirmed rows, i.e. LLM answers no user has reviewed yet, are served by
+ * lookups but teach neither the classifier nor the name templates, and never
+ * replace a confirmed row.
+ *
+ * @param files The entries to store, with file_path holding the directory of each entry.
+ * @param confirmed false for answers the user has not reviewed yet.
+ *
+ * @return A future that is true once every row was committed, false if any row failed.
+ */
+std::future<bool> DatabaseManager::insert_or_update_files_with_categorization(const std::vector<CategorizedFile>& files,
+                                                                              bool confirmed)
+{
+    auto stored = std::make_shared<std::vector<StoredCategorization>>();
+    return submit_write(
+        [this, files, confirmed, stored] { return write_categorizations(files, confirmed, *stored); },
+        [this, confirmed, stored] {
+            for (const auto& [file, previous] : *stored) {
+                const Categorization categorization{file.category, file.subcategory};
+                if (confirmed && (!previous || previous->category != categorization.category ||
+                                  previous->subcategory != categorization.subcategory)) {
+                    if (previous) {
+                        classifier.learn(file.file_name, file.type, *previous, -1);
+                    }
+                    classifier.learn(file.file_name, file.type, categorization);
+                }
+                cache.store(file.file_name, file.type, categorization);
+            }
+        });
+}
+
+
+/**
+ * Writes categorizations within the transaction of the writer thread.
+ *
+ * @param files The entries to store.
+ * @param confirmed false for answers the user has not reviewed yet; these skip
+ *                  the rows that are already confirmed.
+ * @param stored Receives every written row, canonicalized, with the confirmed
+ *               categorization it replaced.
+ *
+ * @return true if every row was written or skipped, false otherwise.
+ */
+bool DatabaseManager::write_categorizations(const std::vector<CategorizedFile>& files, bool confirmed,
+                                            std::vector<StoredCategorization>& stored)
+{
+    if (files.empty()) {
+        return true;
+    }
+
+    const char *select_sql = R"(
+        SELECT category, subcategory, confirmed FROM file_categorization
+        WHERE dir_id = ? AND file_name = ? AND file_type = ?;
+    )";
+    const char *upsert_sql = R"(
+        INSERT INTO file_categorization (dir_id, file_name, file_type, category, subcategory,
+                                         category_id, subcategory_id, confirmed)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+        ON CONFLICT(dir_id, file_name, file_type)
+        DO UPDATE SET category = excluded.category, subcategory = excluded.subcategory,
+                      category_id = excluded.category_id, subcategory_id = excluded.subcategory_id,
+                      confirmed = excluded.confirmed, timestamp = CURRENT_TIMESTAMP;
+    )";
+    auto select_stmt = statements.acquire(select_sql);
+    auto upsert_stmt = statements.acquire(upsert_sql);
+    auto template_stmt = statements.acquire(NAME_TEMPLATE_UPSERT_SQL);
+    if (!select_stmt || !upsert_stmt || !template_stmt) {
+        return false;
+    }
+
+    std::vector<Categorization> canonical;
+    canonical.reserve(files.size());
+    std::map<std::string, long> category_uses;
+    std::map<std::pair<std::string, std::string>, long> subcategory_uses;
+    for (const auto& file : files) {
+        canonical.push_back(vocabulary.canonicalize({file.category, file.subcategory}));
+        ++category_uses[canonical.back().category];
+        ++subcategory_uses[{canonical.back().category, canonical.back().subcategory}];
+    }
+
+    // Every distinct name is interned once, counting all of its uses in the batch
+    std::map<std::string, int> category_ids;
+    for (const auto& [name, uses] : category_uses) {
+        category_ids[name] = intern_category(name, 0, uses);
+    }
+    std::map<std::pair<std::string, std::string>, int> subcategory_ids;
+    for (const auto& [names, uses] : subcategory_uses) {
+        const int category_id = category_ids[names.first];
+        subcategory_ids[names] = category_id != 0 ? intern_category(names.second, category_id, uses) : 0;
+    }
+
+    std::map<std::string, sqlite3_int64> dir_ids;
+    bool success = true;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const CategorizedFile& file = files[i];
+        const Categorization& categorization = canonical[i];
+        auto [dir_entry, dir_is_new] = dir_ids.try_emplace(file.file_path, 0);
+        if (dir_is_new) {
+            dir_entry->second = intern_directory(file.file_path);
+        }
+        const sqlite3_int64 dir_id = dir_entry->second;
+        if (dir_id == 0) {
+            g_print("SQL error while storing the directory of %s: %s\n", file.file_name.c_str(), sqlite3_errmsg(db));
+            success = false;
+            continue;
+        }
+        const std::string file_type = (file.type == FileType::Directory) ? "D" : "F";
+        const int category_id = category_ids[categorization.category];
+        const int subcategory_id = subcategory_ids[{categorization.category, categorization.subcategory}];
+
+        sqlite3_bind_int64(select_stmt.get(), 1, dir_id);
+        sqlite3_bind_text(select_stmt.get(), 2, file.file_name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(select_stmt.get(), 3, file_type.c_str(), -1, SQLITE_STATIC);
+
+        std::optional<Categorization> previous;
+        if (sqlite3_step(select_stmt.get()) == SQLITE_ROW && sqlite3_column_int(select_stmt.get(), 2) != 0) {
+            const char* category = reinterpret_cast<const char*>(sqlite3_column_text(select_stmt.get(), 0));
+            const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(select_stmt.get(), 1));
+            previous = Categorization{category ? category : "", subcategory ? subcategory : ""};
+        }
+        select_stmt.reset();
+        if (!confirmed && previous) {
+            continue;
+        }
+
+        sqlite3_bind_int64(upsert_stmt.get(), 1, dir_id);
+        sqlite3_bind_text(upsert_stmt.get(), 2, file.file_name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(upsert_stmt.get(), 3, file_type.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(upsert_stmt.get(), 4, categorization.category.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(upsert_stmt.get(), 5, categorization.subcategory.c_str(), -1, SQLITE_STATIC);
+        if (category_id != 0) {
+            sqlite3_bind_int(upsert_stmt.get(), 6, category_id);
+        } else {
+            sqlite3_bind_null(upsert_stmt.get(), 6);
+        }
+        if (subcategory_id != 0) {
+            sqlite3_bind_int(upsert_stmt.get(), 7, subcategory_id);
+        } else {
+            sqlite3_bind_null(upsert_stmt.get(), 7);
+        }
+        sqlite3_bind_int(upsert_stmt.get(), 8, confirmed ? 1 : 0);
+
+        const bool written = sqlite3_step(upsert_stmt.get()) == SQLITE_DONE;
+        upsert_stmt.reset();
+        if (!written) {
+            g_print("SQL error during insert or update of %s: %s\n", file.file_name.c_str(), sqlite3_errmsg(db));
+            success = false;
+            continue;
+        }
+        stored.push_back({CategorizedFile{file.file_path, file.file_name, file.type,
+                                          categorization.category, categorization.subcategory},
+                          previous});
+
+        if (confirmed && !update_name_template(template_stmt.get(), file.file_name, file_type,
+                                               categorization.category, categorization.subcategory)) {
+            success = false;
+        }
+    }
+
+    if (!stored.empty() && !bump_cache_generation()) {
+        g_print("SQL error while updating the cache generation: %s\n", sqlite3_errmsg(db));
+        success = false;
+    }
+
+    return success;
+}
+
+
+/**
+ * Returns the id of a directory path in the 'directories' table, adding the path if it is new.
+ *
+ * @param dir_path The directory path.
+ *
+ * @return The id of the path, or 0 if it cannot be stored.
+ */
+sqlite3_int64 DatabaseManager::intern_directory(const std::string& dir_path)
+{
+    {
+        auto stmt = statements.acquire("SELECT id FROM directories WHERE path = ?;");
+        if (!stmt) {
+            return 0;
+        }
+        sqlite3_bind_text(stmt.get(), 1, dir_path.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            return sqlite3_column_int64(stmt.get(), 0);
+        }
+    }
+
+    auto stmt = statements.acquire("INSERT INTO directories (path) VALUES (?);");
+    if (!stmt) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt.get(), 1, dir_path.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+        return 0;
+    }
+    return sqlite3_last_insert_rowid(db);
+}
+
+
+/**
+ * Records the categorization of a name under its template key.
+ *
+ * Names without a template key are skipped. A template that is confirmed again
+ * with the same categorization counts one more sample; a different
+ * categorization replaces the stored one and restarts the count.
+ *
+ * @param stmt The prepared NAME_TEMPLATE_UPSERT_SQL statement, reset after use.
+ * @param file_name The name of the file or directory.
+ * @param file_type The type of the entry, "F" or "D".
+ * @param category The category assigned to the entry.
+ * @param subcategory The subcategory assigned to the entry.
+ *
+ * @return true if the operation was successful or there was nothing to record, false otherwise.
+ */
+bool DatabaseManager::update_name_template(sqlite3_stmt* stmt,
+                                           const std::string& file_name,
+                                           const std::string& file_type,
+                                           const std::string& category,
+                                           const std::string& subcategory)
+{
+    const std::string template_key = NameTemplate::derive(file_name);
+    if (template_key.empty()) {
+        return true;
+    }
+
+    sqlite3_bind_text(stmt, 1, template_key.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, file_type.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, category.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, subcategory.c_str(), -1, SQLITE_STATIC);
+
+    bool success = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!success) {
+        g_print("SQL error during template update: %s\n", sqlite3_errmsg(db));
+    }
+
+    sqlite3_reset(stmt);
+    return success;
+}
+
+
+/**
+ * Retrieves a list of categorized files from the database for a given directory path.
+ *
+ * @param directory_path The directory path to filter categorized files by.
+ * 
+ * @return A vector of CategorizedFile objects, each containing metadata such as directory path,
+ *         file name, file type, category, and subcategory.
+ *
+ * This function executes an SQL query to select categorized files from the 'file_categorization'
+ * table where the directory path matches the specified parameter. If the directory path cannot
+ * be bound or the query preparation fails, an empty vector is returned. The query results
+ * are transformed into CategorizedFile objects which are then collected into a vector.
+ */
+
+std::vector<CategorizedFile>
+DatabaseManager::get_categorized_files(const std::string& directory_path)
+{
+    std::vector<CategorizedFile> categorized_files;
+    ReadLease connection = reader();
+    auto stmt = connection->statements.acquire(R"(
+        SELECT d.path, f.file_name, f.file_type, f.category, f.subcategory
+        FROM directories d JOIN file_categorization f ON f.dir_id = d.id
+        WHERE d.path = ?;
+    )");
+    if (!stmt) {
+        return categorized_files;
+    }
+    sqlite3_stmt *stmtcat = stmt.get();
+
+    if (sqlite3_bind_text(stmtcat, 1, directory_path.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
+        std::cerr << "Failed to bind directory_path: " << sqlite3_errmsg(connection->db) << std::endl;
+        return categorized_files;
+    }
+
+    int rc;
+    while ((rc = sqlite3_step(stmtcat)) == SQLITE_ROW) {
+        const char* file_dir_path = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 0));
+        const char* file_name = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 1));
+        const char* file_type = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 2));
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 3));
+        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 4));
+
+        // Ensure null safety for strings
+        std::string dir_path = file_dir_path ? file_dir_path : "";
+        std::string name = file_name ? file_name : "";
+        std::string type_str = file_type ? file_type : "";
+        std::string cat = category ? category : "";
+        std::string subcat = subcategory ? subcategory : "";
+
+        FileType file_type_enum = (type_str == "F") ? FileType::File : FileType::Directory;
+
+        categorized_files.push_back({dir_path, name, file_type_enum, cat, subcat});
+    }
+
+    return categorized_files;
+}
+
+
+/**
+ * Retrieves the categorization of a file from the database.
+ *
+ * Once the categorization cache is loaded, this is a hash probe in memory;
+ * until then the database is queried.
+ *
+ * @param file_name The name of the file to query.
+ * @param file_type The type of the file to query (file or directory).
+ *
+ * @return A vector of two strings, where the first element is the category and the second element is the subcategory.
+ *         If the query fails or the file does not exist in the database, an empty vector is returned.
+ */
+std::vector<std::string>
+DatabaseManager::get_categorization_from_db(const std::string& file_name, const FileType file_type)
+{
+    std::vector<std::string> categorization;
+    Categorization cached;
+    switch (cache.lookup(file_name, file_type, cached)) {
+        case CategorizationCache::Lookup::Hit:
+            return {cached.category, cached.subcategory};
+        case CategorizationCache::Lookup::Miss:
+            return categorization;
+        case CategorizationCache::Lookup::NotLoaded:
+            break;
+    }
+
+    ReadLease connection = reader();
+    auto stmt = connection->statements.acquire("SELECT category, subcategory FROM file_categorization WHERE file_name = ? AND file_type = ? ORDER BY id DESC LIMIT 1;");
+    if (!stmt) {
+        return categorization;
+    }
+    sqlite3_stmt *stmtcat = stmt.get();
+
+    if (sqlite3_bind_text(stmtcat, 1, file_name.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
+        std::cerr << "Failed to bind file_name: " << sqlite3_errmsg(connection->db) << std::endl;
+        return categorization;
+    }
+
+    std::string file_type_str = (file_type == FileType::File) ? "F" : "D";
+
+    if (sqlite3_bind_text(stmtcat, 2, file_type_str.c_str(), -1, SQLITE_STATIC) != SQLITE_OK) {
+        std::cerr << "Failed to bind file_type: " << sqlite3_errmsg(connection->db) << std::endl;
+        return categorization;
+    }
+
+    int rc;
+    if ((rc = sqlite3_step(stmtcat)) == SQLITE_ROW) {
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 0));
+        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 1));
+
+        // std::cout << "Got categorization from DB: " << category << " " << subcategory << std::endl;
+
+        categorization.push_back(category ? category : "");
+        categorization.push_back(subcategory ? subcategory : "");
+    }
+
+    return categorization;
+}
+
+/**
+ * Retrieves the stored categorizations of many entries at once.
+ *
+ * Entries are looked up by name first. Files whose name is unknown but whose
+ * fingerprint matches a categorized file, e.g. renamed or moved copies or
+ * re-downloads with a " (1)" suffix, get the categorization of that file.
+ *
+ * @param entries The files and directories to look up.
+ *
+ * @return One element per entry, in input order: the stored categorization,
+ *         or an empty optional if the entry is unknown.
+ */
+std::vector<std::optional<Categorization>> DatabaseManager::lookup_many(std::span<const FileEntry> entries)
+{
+    std::vector<std::optional<Categorization>> found(entries.size());
+    if (entries.empty()) {
+        return found;
+    }
+
+    find_by_name(entries, found);
+    find_by_fingerprint(entries, found);
+    return found;
+}
+
+
+/**
+ * Looks up entries by name, filling in the elements of found.
+ *
+ * Once the categorization cache is loaded, every entry is a hash probe in
+ * memory. Until then the names are written to a temporary table and resolved
+ * with a single join, instead of one query per entry. When a name is stored in
+ * several directories the newest row wins, as it does in the cache.
+ */
+void DatabaseManager::find_by_name(std::span<const FileEntry> entries,
+                                   std::vector<std::optional<Categorization>>& found)
+{
+    if (cache.is_loaded()) {
+        Categorization cached;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (cache.lookup(entries[i].file_name, entries[i].type, cached) == CategorizationCache::Lookup::Hit) {
+                found[i] = cached;
+            }
+        }
+        return;
+    }
+
+    ReadLease connection = reader();
+    const char *create_sql = R"(
+        CREATE TEMP TABLE IF NOT EXISTS lookup_names (
+            position INTEGER PRIMARY KEY,
+            file_name TEXT NOT NULL,
+            file_type TEXT NOT NULL
+        );
+    )";
+    if (sqlite3_exec(connection->db, create_sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(connection->db));
+        return;
+    }
+
+    auto insert_stmt = connection->statements.acquire("INSERT INTO lookup_names (position, file_name, file_type) VALUES (?, ?, ?);");
+    auto select_stmt = connection->statements.acquire(R"(
+        SELECT l.position, f.category, f.subcategory
+        FROM lookup_names l JOIN file_categorization f
+             ON f.file_name = l.file_name AND f.file_type = l.file_type
+        ORDER BY l.position, f.id DESC;
+    )");
+    if (!insert_stmt || !select_stmt) {
+        return;
+    }
+
+    sqlite3_exec(connection->db, "BEGIN;", nullptr, nullptr, nullptr);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        sqlite3_bind_int64(insert_stmt.get(), 1, static_cast<sqlite3_int64>(i));
+        sqlite3_bind_text(insert_stmt.get(), 2, entries[i].file_name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(insert_stmt.get(), 3, entries[i].type == FileType::File ? "F" : "D", -1, SQLITE_STATIC);
+        if (sqlite3_step(insert_stmt.get()) != SQLITE_DONE) {
+            g_print("SQL error during lookup of %s: %s\n", entries[i].file_name.c_str(), sqlite3_errmsg(connection->db));
+        }
+        insert_stmt.reset();
+    }
+
+    while (sqlite3_step(select_stmt.get()) == SQLITE_ROW) {
+        const size_t position = static_cast<size_t>(sqlite3_column_int64(select_stmt.get(), 0));
+        if (position >= found.size() || found[position]) {
+            continue;
+        }
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(select_stmt.get(), 1));
+        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(select_stmt.get(), 2));
+        found[position] = Categorization{category ? category : "", subcategory ? subcategory : ""};
+    }
+    select_stmt.reset();
+
+    sqlite3_exec(connection->db, "DELETE FROM lookup_names;", nullptr, nullptr, nullptr);
+    sqlite3_exec(connection->db, "COMMIT;", nullptr, nullptr, nullptr);
+
+}
+
+
+/**
+ * Looks up the entries still missing in found by the fingerprint of their contents.
+ *
+ * Like find_by_name, the fingerprints are written to a temporary table and
+ * resolved with a single join. When several stored files share the contents,
+ * the newest categorization wins.
+ */
+void DatabaseManager::find_by_fingerprint(std::span<const FileEntry> entries,
+                                          std::vector<std::optional<Categorization>>& found)
+{
+    bool has_candidates = false;
+    for (size_t i = 0; i < entries.size() && !has_candidates; ++i) {
+        has_candidates = entries[i].fingerprint && !found[i];
+    }
+    if (!has_candidates) {
+        return;
+    }
+
+    ReadLease connection = reader();
+    const char *create_sql = R"(
+        CREATE TEMP TABLE IF NOT EXISTS lookup_fingerprints (
+            position INTEGER PRIMARY KEY,
+            content_hash INTEGER NOT NULL,
+            file_size INTEGER NOT NULL
+        );
+    )";
+    if (sqlite3_exec(connection->db, create_sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(connection->db));
+        return;
+    }
+
+    auto insert_stmt = connection->statements.acquire(
+        "INSERT INTO lookup_fingerprints (position, content_hash, file_size) VALUES (?, ?, ?);");
+    auto select_stmt = connection->statements.acquire(R"(
+        SELECT l.position, f.category, f.subcategory
+        FROM lookup_fingerprints l
+             JOIN file_fingerprints p ON p.content_hash = l.content_hash AND p.file_size = l.file_size
+             JOIN file_categorization f
+             ON f.dir_id = p.dir_id AND f.file_name = p.file_name AND f.file_type = 'F'
+        ORDER BY l.position, f.id DESC;
+    )");
+    if (!insert_stmt || !select_stmt) {
+        return;
+    }
+
+    sqlite3_exec(connection->db, "BEGIN;", nullptr, nullptr, nullptr);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& fingerprint = entries[i].fingerprint;
+        if (found[i] || !fingerprint) {
+            continue;
+        }
+
+        sqlite3_bind_int64(insert_stmt.get(), 1, static_cast<sqlite3_int64>(i));
+        sqlite3_bind_int64(insert_stmt.get(), 2, static_cast<sqlite3_int64>(fingerprint->content_hash));
+        sqlite3_bind_int64(insert_stmt.get(), 3, static_cast<sqlite3_int64>(fingerprint->size));
+        if (sqlite3_step(insert_stmt.get()) != SQLITE_DONE) {
+            g_print("SQL error during lookup of %s: %s\n", entries[i].file_name.c_str(), sqlite3_errmsg(connection->db));
+        }
+        insert_stmt.reset();
+    }
+
+    while (sqlite3_step(select_stmt.get()) == SQLITE_ROW) {
+        const size_t position = static_cast<size_t>(sqlite3_column_int64(select_stmt.get(), 0));
+        if (position >= found.size() || found[position]) {
+            continue;
+        }
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(select_stmt.get(), 1));
+        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(select_stmt.get(), 2));
+        found[position] = Categorization{category ? category : "", subcategory ? subcategory : ""};
+    }
+    select_stmt.reset();
+
+    sqlite3_exec(connection->db, "DELETE FROM lookup_fingerprints;", nullptr, nullptr, nullptr);
+    sqlite3_exec(connection->db, "COMMIT;", nullptr, nullptr, nullptr);
+}
+
+
+/**
+ * Retrieves the fingerprints stored for the files at the paths of the entries.
+ *
+ * The paths are written to a temporary table and resolved with a single join,
+ * instead of one query per entry.
+ *
+ * @param entries The entries to look up.
+ *
+ * @return One element per entry, in input order: the stored fingerprint, or an
+ *         empty optional if none was stored.
+ */
+std::vector<std::optional<FileFingerprint>> DatabaseManager::get_fingerprints(std::span<const FileEntry> entries)
+{
+    std::vector<std::optional<FileFingerprint>> fingerprints(entries.size());
+    if (entries.empty()) {
+        return fingerprints;
+    }
+
+    ReadLease connection = reader();
+    const char *create_sql = R"(
+        CREATE TEMP TABLE IF NOT EXISTS lookup_paths (
+            position INTEGER PRIMARY KEY,
+            dir_path TEXT NOT NULL,
+            file_name TEXT NOT NULL
+        );
+    )";
+    if (sqlite3_exec(connection->db, create_sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(connection->db));
+        return fingerprints;
+    }
+
+    auto insert_stmt = connection->statements.acquire(
+        "INSERT INTO lookup_paths (position, dir_path, file_name) VALUES (?, ?, ?);");
+    auto select_stmt = connection->statements.acquire(R"(
+        SELECT l.position, p.file_size, p.file_mtime, p.content_hash
+        FROM lookup_paths l
+             JOIN directories d ON d.path = l.dir_path
+             JOIN file_fingerprints p ON p.dir_id = d.id AND p.file_name = l.file_name;
+    )");
+    if (!insert_stmt || !select_stmt) {
+        return fingerprints;
+    }
+
+    sqlite3_exec(connection->db, "BEGIN;", nullptr, nullptr, nullptr);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].type != FileType::File) {
+            continue;
+        }
+
+        const std::string dir_path = std::filesystem::path(entries[i].full_path).parent_path().string();
+        sqlite3_bind_int64(insert_stmt.get(), 1, static_cast<sqlite3_int64>(i));
+        sqlite3_bind_text(insert_stmt.get(), 2, dir_path.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(insert_stmt.get(), 3, entries[i].file_name.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(insert_stmt.get()) != SQLITE_DONE) {
+            g_print("SQL error during lookup of %s: %s\n", entries[i].file_name.c_str(), sqlite3_errmsg(connection->db));
+        }
+        insert_stmt.reset();
+    }
+
+    while (sqlite3_step(select_stmt.get()) == SQLITE_ROW) {
+        const size_t position = static_cast<size_t>(sqlite3_column_int64(select_stmt.get(), 0));
+        if (position >= fingerprints.size()) {
+            continue;
+        }
+        fingerprints[position] = FileFingerprint{
+            static_cast<uint64_t>(sqlite3_column_int64(select_stmt.get(), 1)),
+            static_cast<int64_t>(sqlite3_column_int64(select_stmt.get(), 2)),
+            static_cast<uint64_t>(sqlite3_column_int64(select_stmt.get(), 3))};
+    }
+    select_stmt.reset();
+
+    sqlite3_exec(connection->db, "DELETE FROM lookup_paths;", nullptr, nullptr, nullptr);
+    sqlite3_exec(connection->db, "COMMIT;", nullptr, nullptr, nullptr);
+
+    return fingerprints;
+}
+
+
+/**
+ * Queues the fingerprints of entries to be stored, replacing older ones for the same path.
+ *
+ * @param entries The entries; those without a fingerprint are skipped.
+ *
+ * @return A future that is true once the fingerprints were committed, false otherwise.
+ */
+std::future<bool> DatabaseManager::store_fingerprints(const std::vector<FileEntry>& entries)
+{
+    return submit_write([this, entries] {
+        const char *sql = R"(
+            INSERT INTO file_fingerprints (dir_id, file_name, file_size, file_mtime, content_hash)
+            VALUES (?, ?, ?, ?, ?)
+            ON CONFLICT(dir_id, file_name)
+            DO UPDATE SET file_size = excluded.file_size, file_mtime = excluded.file_mtime,
+                          content_hash = excluded.content_hash;
+        )";
+        auto stmt = statements.acquire(sql);
+        if (!stmt) {
+            return false;
+        }
+
+        std::map<std::string, sqlite3_int64> dir_ids;
+        bool success = true;
+        for (const auto& entry : entries) {
+            if (!entry.fingerprint) {
+                continue;
+            }
+
+            const std::string dir_path = std::filesystem::path(entry.full_path).parent_path().string();
+            auto [dir_entry, dir_is_new] = dir_ids.try_emplace(dir_path, 0);
+            if (dir_is_new) {
+                dir_entry->second = intern_directory(dir_path);
+            }
+            if (dir_entry->second == 0) {
+                success = false;
+                continue;
+            }
+
+            sqlite3_bind_int64(stmt.get(), 1, dir_entry->second);
+            sqlite3_bind_text(stmt.get(), 2, entry.file_name.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(stmt.get(), 3, static_cast<sqlite3_int64>(entry.fingerprint->size));
+            sqlite3_bind_int64(stmt.get(), 4, static_cast<sqlite3_int64>(entry.fingerprint->mtime));
+            sqlite3_bind_int64(stmt.get(), 5, static_cast<sqlite3_int64>(entry.fingerprint->content_hash));
+            if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+                g_print("SQL error while storing the fingerprint of %s: %s\n", entry.file_name.c_str(), sqlite3_errmsg(db));
+                success = false;
+            }
+            stmt.reset();
+        }
+        return success;
+    });
+}
+
+
+/**
+ * Retrieves the categorization recorded for names sharing the template key of a name.
+ *
+ * @param file_name The name of the file to query.
+ * @param file_type The type of the file to query (file or directory).
+ *
+ * @return A vector of two strings, where the first element is the category and the second element is the subcategory.
+ *         If the name has no template key or the template is unknown, an empty vector is returned.
+ */
+std::vector<std::string>
+DatabaseManager::get_categorization_from_template(const std::string& file_name, const FileType file_type)
+{
+    std::vector<std::string> categorization;
+    const std::string template_key = NameTemplate::derive(file_name);
+    if (template_key.empty()) {
+        return categorization;
+    }
+
+    ReadLease connection = reader();
+    auto stmt = connection->statements.acquire("SELECT category, subcategory FROM file_name_templates WHERE template_key = ? AND file_type = ?;");
+    if (!stmt) {
+        return categorization;
+    }
+    sqlite3_stmt *stmtcat = stmt.get();
+
+    std::string file_type_str = (file_type == FileType::File) ? "F" : "D";
+    sqlite3_bind_text(stmtcat, 1, template_key.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmtcat, 2, file_type_str.c_str(), -1, SQLITE_STATIC);
+
+    if (sqlite3_step(stmtcat) == SQLITE_ROW) {
+        const char* category = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 0));
+        const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(stmtcat, 1));
+
+        categorization.push_back(category ? category : "");
+        categorization.push_back(subcategory ? subcategory : "");
+    }
+
+    return categorization;
+}
+
+
+/**
+ * Queues entries whose categorization has to wait until the LLM can be reached.
+ *
+ * Entries that are already queued keep their place in the queue. Like every
+ * write, this is carried out by the writer thread.
+ *
+ * @param entries The files and directories to queue.
+ *
+ * @return A future that is true once all entries were queued, false otherwise.
+ */
+std::future<bool> DatabaseManager::enqueue_pending_categorizations(const std::vector<FileEntry>& entries)
+{
+    return submit_write([this, entries] { return write_pending_categorizations(entries); });
+}
+
+
+/**
+ * Adds entries to the queue, within the transaction of the writer thread.
+ */
+bool DatabaseManager::write_pending_categorizations(const std::vector<FileEntry>& entries)
+{
+    const char *sql = R"(
+        INSERT INTO pending_categorization (file_name, file_type, dir_path, full_path, content_type)
+        VALUES (?, ?, ?, ?, ?)
+        ON CONFLICT(file_name, file_type, dir_path) DO NOTHING;
+    )";
+    auto stmt = statements.acquire(sql);
+    if (!stmt) {
+        return false;
+    }
+
+    bool success = true;
+    for (const auto& entry : entries) {
+        const std::string file_type = (entry.type == FileType::File) ? "F" : "D";
+        const std::string dir_path = std::filesystem::path(entry.full_path).parent_path().string();
+
+        sqlite3_bind_text(stmt.get(), 1, entry.file_name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt.get(), 2, file_type.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt.get(), 3, dir_path.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt.get(), 4, entry.full_path.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt.get(), 5, entry.content_type.c_str(), -1, SQLITE_STATIC);
+
+        if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+            g_print("SQL error while queueing %s: %s\n", entry.file_name.c_str(), sqlite3_errmsg(db));
+            success = false;
+        }
+        stmt.reset();
+    }
+
+    return success;
+}
+
+
+/**
+ * Retrieves the oldest queued entries that have not failed too often.
+ *
+ * @param limit The number of entries to return at most.
+ *
+ * @return The queued entries, oldest first.
+ */
+std::vector<FileEntry> DatabaseManager::get_pending_categorizations(size_t limit)
+{
+    std::vector<FileEntry> entries;
+    const char *sql = R"(
+        SELECT full_path, file_name, file_type, content_type FROM pending_categorization
+        WHERE attempts < ? ORDER BY queued_at LIMIT ?;
+    )";
+    ReadLease connection = reader();
+    auto stmt = connection->statements.acquire(sql);
+    if (!stmt) {
+        return entries;
+    }
+
+    sqlite3_bind_int(stmt.get(), 1, MAX_PENDING_ATTEMPTS);
+    sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(limit));
+
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        const char* full_path = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 0));
+        const char* file_name = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 1));
+        const char* file_type = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 2));
+        const char* content_type = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 3));
+
+        entries.push_back({full_path ? full_path : "",
+                           file_name ? file_name : "",
+                           (file_type && std::string(file_type) == "D") ? FileType::Directory : FileType::File,
+                           content_type ? content_type : ""});
+    }
+
+    return entries;
+}
+
+
+/**
+ * Removes categorized entries from the queue.
+ *
+ * @param entries The entries to remove.
+ *
+ * @return A future that is true once the entries were removed, false otherwise.
+ */
+std::future<bool> DatabaseManager::remove_pending_categorizations(const std::vector<FileEntry>& entries)
+{
+    return submit_write([this, entries] {
+        return update_pending(R"(
+            DELETE FROM pending_categorization WHERE file_name = ? AND file_type = ? AND dir_path = ?;
+        )", entries);
+    });
+}
+
+
+/**
+ * Counts one more failed attempt for queued entries the LLM gave no answer for.
+ *
+ * Entries that failed MAX_PENDING_ATTEMPTS times are no longer returned by get_pending_categorizations().
+ *
+ * @param entries The entries to update.
+ *
+ * @return A future that is true once the entries were updated, false otherwise.
+ */
+std::future<bool> DatabaseManager::record_pending_attempts(const std::vector<FileEntry>& entries)
+{
+    return submit_write([this, entries] {
+        return update_pending(R"(
+            UPDATE pending_categorization SET attempts = attempts + 1
+            WHERE file_name = ? AND file_type = ? AND dir_path = ?;
+        )", entries);
+    });
+}
+
+
+/**
+ * Runs a statement keyed by file name, type and directory for each entry,
+ * within the transaction of the writer thread.
+ */
+bool DatabaseManager::update_pending(const char* sql, const std::vector<FileEntry>& entries)
+{
+    auto stmt = statements.acquire(sql);
+    if (!stmt) {
+        return false;
+    }
+
+    bool success = true;
+    for (const auto& entry : entries) {
+        const std::string file_type = (entry.type == FileType::File) ? "F" : "D";
+        const std::string dir_path = std::filesystem::path(entry.full_path).parent_path().string();
+
+        sqlite3_bind_text(stmt.get(), 1, entry.file_name.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt.get(), 2, file_type.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt.get(), 3, dir_path.c_str(), -1, SQLITE_STATIC);
+
+        if (sqlite3_step(stmt.get()) != SQLITE_DONE) {
+            g_print("SQL error on the pending queue: %s\n", sqlite3_errmsg(db));
+            success = false;
+        }
+        stmt.reset();
+    }
+
+    return success;
+}
+
+
+/**
+ * Queues work that must run outside a transaction, such as VACUUM, for the writer thread.
+ *
+ * @param apply Runs on the writer thread once the writes queued before it are committed.
+ *
+ * @return A future holding the result of apply.
+ */
+std::future<bool> DatabaseManager::submit_standalone(std::function<bool()> apply)
+{
+    WriteRequest request;
+    request.apply = std::move(apply);
+    request.standalone = true;
+    std::future<bool> done = request.done.get_future();
+
+    if (!writer.joinable()) {
+        request.done.set_value(false);
+        return done;
+    }
+
+    write_queue.push(std::move(request));
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+    }
+    writer_wakeup.notify_one();
+    return done;
+}
+
+
+/**
+ * Prunes the rows of files that no longer exist and compacts the database.
+ *
+ * The directories are visited in path order, and the rows of each are checked
+ * against the filesystem, one status call per file, or a single one for a
+ * directory that is gone. A categorization is pruned once its file is gone and
+ * it was not confirmed for STALE_ROW_RETENTION, so that recently sorted files
+ * are still recognized by name; the name templates keep what was learned from
+ * older ones. Fingerprints of files that are gone and were never categorized
+ * are pruned right away. The deletions go through the writer thread in batches
+ * of MAINTENANCE_BATCH_SIZE rows, with a pause after each, so maintenance never
+ * holds the writer for long. Once all directories were checked, the freed pages
+ * are returned to the file system and the query planner statistics refreshed
+ * (see compact_database).
+ *
+ * @param stop_flag Stops maintenance after the current batch when raised.
+ *
+ * @return What was checked, pruned and reclaimed.
+ */
+DatabaseManager::MaintenanceReport DatabaseManager::run_maintenance(const std::atomic<bool>& stop_flag)
+{
+    MaintenanceReport report;
+    ReadLease connection = reader();
+
+    std::vector<std::pair<sqlite3_int64, std::string>> directories;
+    {
+        auto stmt = connection->statements.acquire("SELECT id, path FROM directories ORDER BY path;");
+        if (!stmt) {
+            return report;
+        }
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            const char* path = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 1));
+            directories.emplace_back(sqlite3_column_int64(stmt.get(), 0), path ? path : "");
+        }
+    }
+
+    auto candidates = connection->statements.acquire(R"(
+        SELECT file_name, file_type, 1 FROM file_categorization
+        WHERE dir_id = ?1 AND timestamp < datetime('now', ?2)
+        UNION ALL
+        SELECT p.file_name, 'F', 0 FROM file_fingerprints p
+        WHERE p.dir_id = ?1 AND NOT EXISTS (
+            SELECT 1 FROM file_categorization f
+            WHERE f.dir_id = p.dir_id AND f.file_name = p.file_name AND f.file_type = 'F');
+    )");
+    if (!candidates) {
+        return report;
+    }
+
+    std::vector<StaleRow> stale;
+    size_t checked_since_pause = 0;
+    auto flush = [&]() {
+        if (!stale.empty() && prune_stale_rows(stale).get()) {
+            report.rows_pruned += stale.size();
+        }
+        stale.clear();
+        checked_since_pause = 0;
+        std::this_thread::sleep_for(MAINTENANCE_PAUSE);
+    };
+
+    for (const auto& [dir_id, dir_path] : directories) {
+        if (stop_flag) {
+            return report;
+        }
+
+        sqlite3_bind_int64(candidates.get(), 1, dir_id);
+        sqlite3_bind_text(candidates.get(), 2, STALE_ROW_RETENTION, -1, SQLITE_STATIC);
+        std::vector<StaleRow> rows;
+        while (sqlite3_step(candidates.get()) == SQLITE_ROW) {
+            const char* file_name = reinterpret_cast<const char*>(sqlite3_column_text(candidates.get(), 0));
+            const char* file_type = reinterpret_cast<const char*>(sqlite3_column_text(candidates.get(), 1));
+            rows.push_back({dir_id, file_name ? file_name : "", file_type ? file_type : "F",
+                            sqlite3_column_int(candidates.get(), 2) != 0});
+        }
+        candidates.reset();
+        if (rows.empty()) {
+            continue;
+        }
+
+        // Entries that cannot be checked, e.g. for lack of permission, are kept
+        std::error_code error;
+        const bool dir_exists = std::filesystem::exists(dir_path, error);
+        if (error) {
+            continue;
+        }
+        for (auto& row : rows) {
+            const bool exists = dir_exists &&
+                std::filesystem::exists(std::filesystem::path(dir_path) / row.file_name, error);
+            if (!exists && !error) {
+                stale.push_back(std::move(row));
+            }
+            ++report.rows_checked;
+            if (++checked_since_pause >= MAINTENANCE_BATCH_SIZE) {
+                flush();
+                if (stop_flag) {
+                    return report;
+                }
+            }
+        }
+    }
+    flush();
+
+    if (!stop_flag) {
+        report.completed = compact_database(stop_flag, report.bytes_reclaimed);
+    }
+    return report;
+}
+
+
+/**
+ * Queues the deletion of stale rows, and of the directories no row refers to anymore.
+ *
+ * The cache is updated once the deletion is committed: a pruned name falls back
+ * to the latest categorization left under the same name, if any.
+ */
+std::future<bool> DatabaseManager::prune_stale_rows(const std::vector<StaleRow>& rows)
+{
+    auto cache_updates = std::make_shared<std::vector<std::pair<StaleRow, std::optional<Categorization>>>>();
+
+    return submit_write([this, rows, cache_updates] {
+        auto delete_categorization = statements.acquire(
+            "DELETE FROM file_categorization WHERE dir_id = ? AND file_name = ? AND file_type = ?;");
+        auto delete_fingerprint = statements.acquire(
+            "DELETE FROM file_fingerprints WHERE dir_id = ? AND file_name = ?;");
+        auto latest = statements.acquire(R"(
+            SELECT category, subcategory FROM file_categorization
+            WHERE file_name = ? AND file_type = ?
+            ORDER BY id DESC LIMIT 1;
+        )");
+        if (!delete_categorization || !delete_fingerprint || !latest) {
+            return false;
+        }
+
+        cache_updates->clear();
+        for (const auto& row : rows) {
+            if (row.categorized) {
+                sqlite3_bind_int64(delete_categorization.get(), 1, row.dir_id);
+                sqlite3_bind_text(delete_categorization.get(), 2, row.file_name.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_text(delete_categorization.get(), 3, row.file_type.c_str(), -1, SQLITE_STATIC);
+                const bool deleted = sqlite3_step(delete_categorization.get()) == SQLITE_DONE;
+                delete_categorization.reset();
+                if (!deleted) {
+                    g_print("SQL error while pruning %s: %s\n", row.file_name.c_str(), sqlite3_errmsg(db));
+                    return false;
+                }
+
+                std::optional<Categorization> remaining;
+                sqlite3_bind_text(latest.get(), 1, row.file_name.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_text(latest.get(), 2, row.file_type.c_str(), -1, SQLITE_STATIC);
+                if (sqlite3_step(latest.get()) == SQLITE_ROW) {
+                    const char* category = reinterpret_cast<const char*>(sqlite3_column_text(latest.get(), 0));
+                    const char* subcategory = reinterpret_cast<const char*>(sqlite3_column_text(latest.get(), 1));
+                    remaining = Categorization{category ? category : "", subcategory ? subcategory : ""};
+                }
+                latest.reset();
+                cache_updates->emplace_back(row, std::move(remaining));
+            }
+
+            if (row.file_type == "F") {
+                sqlite3_bind_int64(delete_fingerprint.get(), 1, row.dir_id);
+                sqlite3_bind_text(delete_fingerprint.get(), 2, row.file_name.c_str(), -1, SQLITE_STATIC);
+                const bool deleted = sqlite3_step(delete_fingerprint.get()) == SQLITE_DONE;
+                delete_fingerprint.reset();
+                if (!deleted) {
+                    g_print("SQL error while pruning %s: %s\n", row.file_name.c_str(), sqlite3_errmsg(db));
+                    return false;
+                }
+            }
+        }
+
+        const char* orphans_sql = R"(
+            DELETE FROM directories
+            WHERE id NOT IN (SELECT dir_id FROM file_categorization)
+              AND id NOT IN (SELECT dir_id FROM file_fingerprints);
+        )";
+        if (sqlite3_exec(db, orphans_sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+            g_print("SQL error while pruning directories: %s\n", sqlite3_errmsg(db));
+            return false;
+        }
+
+        return cache_updates->empty() || bump_cache_generation();
+    }, [this, cache_updates] {
+        for (const auto& [row, remaining] : *cache_updates) {
+            const FileType file_type = row.file_type == "D" ? FileType::Directory : FileType::File;
+            if (remaining) {
+                cache.store(row.file_name, file_type, *remaining);
+            } else {
+                cache.forget(row.file_name, file_type);
+            }
+        }
+    });
+}
+
+
+/**
+ * Returns free pages to the file system and refreshes the query planner statistics.
+ *
+ * Every step runs on the writer thread, outside any transaction, as a request
+ * of its own, so writes queued meanwhile are committed between the steps.
+ * Free pages are released MAINTENANCE_VACUUM_STEP_PAGES at a time, with a
+ * pause after each step. A database created before incremental auto-vacuum was
+ * enabled is converted by one full VACUUM the first time there is something to
+ * reclaim. That VACUUM and ANALYZE, which samples a limited number of rows per
+ * index, are aborted as soon as stop_flag is raised; only the commit that ends
+ * the VACUUM cannot be interrupted. A final passive checkpoint
+ * copies the WAL back without waiting for readers.
+ *
+ * @param stop_flag Aborts compaction when raised.
+ * @param bytes_reclaimed Receives the number of bytes the database shrank by.
+ *
+ * @return true if every step succeeded, false if one failed or compaction was stopped.
+ */
+bool DatabaseManager::compact_database(const std::atomic<bool>& stop_flag, int64_t& bytes_reclaimed)
+{
+    int64_t page_size = 0;
+    int64_t pages_before = 0;
+    int64_t free_pages = 0;
+    bool incremental = false;
+    if (!submit_standalone([&] {
+            page_size = get_pragma("page_size");
+            pages_before = get_pragma("page_count");
+            free_pages = get_pragma("freelist_count");
+            incremental = get_pragma("auto_vacuum") == 2;
+            return page_size > 0 && pages_before >= 0 && free_pages >= 0;
+        }).get()) {
+        return false;
+    }
+
+    if (free_pages > 0 && !incremental) {
+        if (!submit_standalone([&] {
+                return run_interruptible("PRAGMA auto_vacuum = INCREMENTAL; VACUUM;", stop_flag);
+            }).get()) {
+            return false;
+        }
+        free_pages = 0;
+    }
+
+    const std::string step_sql = "PRAGMA incremental_vacuum(" + std::to_string(MAINTENANCE_VACUUM_STEP_PAGES) + ");";
+    while (free_pages > 0) {
+        if (stop_flag || !submit_standalone([&] {
+                const bool freed = run_interruptible(step_sql.c_str(), stop_flag);
+                free_pages = get_pragma("freelist_count");
+                return freed;
+            }).get()) {
+            return false;
+        }
+        std::this_thread::sleep_for(MAINTENANCE_PAUSE);
+    }
+
+    return !stop_flag && submit_standalone([&] {
+        const char* sql = R"(
+            PRAGMA analysis_limit = 1000;
+            ANALYZE;
+            PRAGMA wal_checkpoint(PASSIVE);
+        )";
+        if (!run_interruptible(sql, stop_flag)) {
+            return false;
+        }
+        bytes_reclaimed = (pages_before - get_pragma("page_count")) * page_size;
+        return true;
+    }).get();
+}
+
+
+/**
+ * Reads the integer value of a pragma on the write connection, e.g. "page_count".
+ *
+ * @return The value, or -1 if it cannot be read.
+ */
+int64_t DatabaseManager::get_pragma(const char* pragma)
+{
+    const std::string sql = std::string("PRAGMA ") + pragma + ";";
+    sqlite3_stmt* stmt;
+    int64_t value = -1;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            value = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return value;
+}
+
+
+/**
+ * Runs SQL on the write connection, aborting it once stop_flag is raised.
+ *
+ * A progress handler polls the flag every few thousand virtual machine
+ * instructions, so even a full VACUUM stops promptly; the statement that was
+ * aborted is rolled back.
+ *
+ * @return true if the SQL ran to completion, false if it failed or was aborted.
+ */
+bool DatabaseManager::run_interruptible(const char* sql, const std::atomic<bool>& stop_flag)
+{
+    sqlite3_progress_handler(db, 4096, [](void* flag) -> int {
+        return static_cast<const std::atomic<bool>*>(flag)->load() ? 1 : 0;
+    }, const_cast<std::atomic<bool>*>(&stop_flag));
+
+    char* error_msg = nullptr;
+    const int result = sqlite3_exec(db, sql, nullptr, nullptr, &error_msg);
+    sqlite3_progress_handler(db, 0, nullptr, nullptr);
+
+    if (result != SQLITE_OK && result != SQLITE_INTERRUPT) {
+        std::cerr << "Failed to compact the database: " << (error_msg ? error_msg : sqlite3_errstr(result)) << std::endl;
+    }
+    sqlite3_free(error_msg);
+    return result == SQLITE_OK;
+}
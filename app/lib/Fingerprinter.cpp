@@ -0,0 +1,257 @@
+#include "Fingerprinter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+
+namespace {
+
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+
+uint64_t rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+
+uint64_t read64(const unsigned char *data)
+{
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+
+uint32_t read32(const unsigned char *data)
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+
+uint64_t round(uint64_t accumulator, uint64_t lane)
+{
+    accumulator += lane * PRIME2;
+    return rotl(accumulator, 31) * PRIME1;
+}
+
+
+uint64_t merge_round(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= round(0, accumulator);
+    return hash * PRIME1 + PRIME4;
+}
+
+}
+
+
+/**
+ * @brief Reads the size and modification time of a regular file.
+ *
+ * @param path The file.
+ * @return The fingerprint without content_hash, or std::nullopt if the path is
+ *         not a regular file or cannot be read.
+ */
+std::optional<FileFingerprint> Fingerprinter::read_metadata(const std::string &path)
+{
+    std::error_code error;
+    const auto status = std::filesystem::status(path, error);
+    if (error || !std::filesystem::is_regular_file(status)) {
+        return std::nullopt;
+    }
+
+    FileFingerprint fingerprint;
+    fingerprint.size = std::filesystem::file_size(path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    const auto mtime = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    fingerprint.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+    return fingerprint;
+}
+
+
+/**
+ * @brief Hashes a sample of the contents of a file.
+ *
+ * Files of up to head_size + tail_size + middle_block_count * middle_block_size
+ * bytes are hashed whole. Of larger files, the head, the tail and evenly
+ * spaced blocks in between are read, so a fingerprint costs at most 256 KB of
+ * I/O however large the file is. The size seeds the hash, so files that only
+ * differ outside the sampled blocks are still told apart when their sizes differ.
+ *
+ * @param path The file.
+ * @param size The size of the file.
+ * @return The hash, or 0 if the file cannot be read.
+ */
+uint64_t Fingerprinter::hash_contents(const std::string &path, uint64_t size)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return 0;
+    }
+
+    const uint64_t sample_size = head_size + tail_size + middle_block_count * middle_block_size;
+    std::string buffer;
+
+    auto read_block = [&](uint64_t offset, size_t length) {
+        const size_t start = buffer.size();
+        buffer.resize(start + length);
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(buffer.data() + start, static_cast<std::streamsize>(length));
+        buffer.resize(start + static_cast<size_t>(std::max<std::streamsize>(file.gcount(), 0)));
+        file.clear();
+    };
+
+    if (size <= sample_size) {
+        read_block(0, static_cast<size_t>(size));
+    } else {
+        buffer.reserve(sample_size);
+        read_block(0, head_size);
+        const uint64_t middle_start = head_size;
+        const uint64_t middle_span = size - head_size - tail_size - middle_block_size;
+        for (size_t i = 0; i < middle_block_count; ++i) {
+            read_block(middle_start + middle_span * (2 * i + 1) / (2 * middle_block_count), middle_block_size);
+        }
+        read_block(size - tail_size, tail_size);
+    }
+
+    if (buffer.size() != std::min(size, sample_size)) {
+        return 0;
+    }
+
+    const uint64_t content_hash = hash(buffer, size);
+    return content_hash == 0 ? 1 : content_hash;
+}
+
+
+/**
+ * @brief Hashes bytes with the 64-bit xxHash algorithm (XXH64).
+ *
+ * The bulk of the input goes through four independent accumulators, one per
+ * 8-byte lane of a 32-byte stripe, so the loop has no dependency between lanes
+ * and runs at memory speed.
+ */
+uint64_t Fingerprinter::hash(std::string_view data, uint64_t seed)
+{
+    const auto *bytes = reinterpret_cast<const unsigned char*>(data.data());
+    const unsigned char *end = bytes + data.size();
+    uint64_t result;
+
+    if (data.size() >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = round(v1, read64(bytes));
+            v2 = round(v2, read64(bytes + 8));
+            v3 = round(v3, read64(bytes + 16));
+            v4 = round(v4, read64(bytes + 24));
+            bytes += 32;
+        } while (bytes <= limit);
+
+        result = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        result = merge_round(result, v1);
+        result = merge_round(result, v2);
+        result = merge_round(result, v3);
+        result = merge_round(result, v4);
+    } else {
+        result = seed + PRIME5;
+    }
+
+    result += static_cast<uint64_t>(data.size());
+
+    for (; bytes + 8 <= end; bytes += 8) {
+        result ^= round(0, read64(bytes));
+        result = rotl(result, 27) * PRIME1 + PRIME4;
+    }
+    if (bytes + 4 <= end) {
+        result ^= static_cast<uint64_t>(read32(bytes)) * PRIME1;
+        result = rotl(result, 23) * PRIME2 + PRIME3;
+        bytes += 4;
+    }
+    for (; bytes < end; ++bytes) {
+        result ^= *bytes * PRIME5;
+        result = rotl(result, 11) * PRIME1;
+    }
+
+    result ^= result >> 33;
+    result *= PRIME2;
+    result ^= result >> 29;
+    result *= PRIME3;
+    result ^= result >> 32;
+    return result;
+}
+
+
+/**
+ * @brief Fingerprints the non-empty regular files among the entries, on several threads.
+ *
+ * A file whose size and modification time still match its known fingerprint
+ * keeps the known content hash without being read again.
+ *
+ * @param entries The entries to fingerprint. Their fingerprint is set, or left unset
+ *                for directories, empty files and files that cannot be read.
+ * @param known The fingerprint stored for each entry, if any, in the same order.
+ * @param cancel_flag Stops the remaining work when raised.
+ */
+void Fingerprinter::fingerprint_files(std::vector<FileEntry> &entries,
+                                      std::span<const std::optional<FileFingerprint>> known,
+                                      const std::atomic<bool> *cancel_flag)
+{
+    std::atomic<size_t> next_entry{0};
+
+    auto worker = [&]() {
+        while (!cancel_flag || !*cancel_flag) {
+            const size_t index = next_entry.fetch_add(1);
+            if (index >= entries.size()) {
+                return;
+            }
+
+            FileEntry &entry = entries[index];
+            if (entry.type != FileType::File) {
+                continue;
+            }
+
+            std::optional<FileFingerprint> fingerprint = read_metadata(entry.full_path);
+            if (!fingerprint || fingerprint->size == 0) {
+                continue;
+            }
+
+            const auto &stored = index < known.size() ? known[index] : std::nullopt;
+            if (stored && stored->size == fingerprint->size && stored->mtime == fingerprint->mtime) {
+                fingerprint->content_hash = stored->content_hash;
+            } else {
+                fingerprint->content_hash = hash_contents(entry.full_path, fingerprint->size);
+            }
+
+            if (fingerprint->content_hash != 0) {
+                entry.fingerprint = fingerprint;
+            }
+        }
+    };
+
+    const size_t thread_count = std::min({static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency())),
+                                          max_threads, entries.size()});
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,288 @@
+#include "HttpTransport.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <stdexcept>
+
+
+// Helper function to write the response from curl into a string
+static size_t WriteCallback(void *contents, size_t size, size_t nmemb, std::string *response)
+{
+    size_t totalSize = size * nmemb;
+    response->append((char *)contents, totalSize);
+    return totalSize;
+}
+
+
+// Collects the response headers with lower-cased names. A new status line
+// starts a new header block, e.g. after a redirect or "100 Continue".
+static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, HttpResponse *response)
+{
+    size_t totalSize = size * nitems;
+    std::string line(buffer, totalSize);
+
+    if (line.rfind("HTTP/", 0) == 0) {
+        response->headers.clear();
+        return totalSize;
+    }
+
+    size_t colon_pos = line.find(':');
+    if (colon_pos == std::string::npos) {
+        return totalSize;
+    }
+
+    std::string name = line.substr(0, colon_pos);
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    std::string value = line.substr(colon_pos + 1);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t\r\n") + 1);
+
+    response->headers[name] = value;
+    return totalSize;
+}
+
+
+// Aborts the transfer as soon as the request's cancel flag is raised
+static int ProgressCallback(void *user_data, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+    const auto *cancel_flag = static_cast<const std::atomic<bool> *>(user_data);
+    return cancel_flag->load() ? 1 : 0;
+}
+
+
+/**
+ * @brief Returns the process-wide transport shared by all HTTP clients.
+ *
+ * The instance is created on first use, which also performs the global
+ * libcurl initialization exactly once.
+ *
+ * @return The shared HttpTransport.
+ */
+HttpTransport& HttpTransport::shared()
+{
+    static HttpTransport transport;
+    return transport;
+}
+
+
+/**
+ * @brief Initializes libcurl and the share handle used by every request.
+ *
+ * The share handle holds the DNS cache and the TLS session cache, so host
+ * lookups and TLS handshakes are only paid once per host. Open connections are
+ * kept alive by the easy handles themselves, which are pooled and reused.
+ */
+HttpTransport::HttpTransport()
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    share = curl_share_init();
+    if (!share) {
+        throw std::runtime_error("Initialization Error: Failed to initialize cURL share handle.");
+    }
+
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, &HttpTransport::lock_share);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, &HttpTransport::unlock_share);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+
+/**
+ * @brief Releases the pooled handles, the share handle and libcurl itself.
+ */
+HttpTransport::~HttpTransport()
+{
+    for (CURL* handle : idle_handles) {
+        curl_easy_cleanup(handle);
+    }
+    idle_handles.clear();
+
+    curl_share_cleanup(share);
+    curl_global_cleanup();
+}
+
+
+/**
+ * @brief Builds a header list that can be kept and reused across requests.
+ *
+ * @param headers The header lines, e.g. "Content-Type: application/json".
+ *
+ * @return A reference-counted curl_slist that is freed with its last owner.
+ */
+HeaderList HttpTransport::make_header_list(const std::vector<std::string>& headers)
+{
+    curl_slist* list = nullptr;
+    for (const auto& header : headers) {
+        list = curl_slist_append(list, header.c_str());
+    }
+    return HeaderList(list, curl_slist_free_all);
+}
+
+
+/**
+ * @brief Performs a single HTTP request on a pooled handle.
+ *
+ * The request is bounded by its connect and total timeouts, and is aborted
+ * within about a second once its cancel flag is raised. Either way the call
+ * returns on the caller's thread and the handle goes back to the pool, so
+ * nothing outlives the request.
+ *
+ * @param request The URL, headers, body, deadlines and cancel flag of the request.
+ *
+ * @return The HTTP status code and body of the response. HTTP error codes are
+ *         returned to the caller as they are.
+ *
+ * @exception std::runtime_error If no handle is available, the request was
+ *            cancelled, the deadline passed or the transfer failed.
+ */
+HttpResponse HttpTransport::perform(const HttpRequest& request)
+{
+    if (request.cancel_flag && request.cancel_flag->load()) {
+        throw std::runtime_error("Cancelled: The request was cancelled.");
+    }
+
+    CURL* handle = acquire_handle();
+    if (!handle) {
+        throw std::runtime_error("Initialization Error: Failed to initialize cURL.");
+    }
+
+    HttpResponse response;
+    configure_handle(handle, request, response);
+
+    CURLcode res = curl_easy_perform(handle);
+    if (res == CURLE_OK) {
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response.status_code);
+    }
+
+    release_handle(handle);
+
+    if (res == CURLE_ABORTED_BY_CALLBACK) {
+        throw std::runtime_error("Cancelled: The request was cancelled.");
+    } else if (res == CURLE_OPERATION_TIMEDOUT) {
+        throw std::runtime_error("Network timeout: No response within " +
+                                 std::to_string(request.timeout_seconds) + " seconds.");
+    } else if (res != CURLE_OK) {
+        throw std::runtime_error("Network Error: " + std::string(curl_easy_strerror(res)));
+    }
+
+    return response;
+}
+
+
+/**
+ * @brief Takes an idle handle from the pool, or creates one if the pool is empty.
+ *
+ * Reused handles keep their open connections, so consecutive requests to the
+ * same host skip the TCP and TLS setup.
+ *
+ * @return A handle owned by the caller until release_handle() is called.
+ */
+CURL* HttpTransport::acquire_handle()
+{
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (!idle_handles.empty()) {
+            CURL* handle = idle_handles.back();
+            idle_handles.pop_back();
+            return handle;
+        }
+    }
+
+    return curl_easy_init();
+}
+
+
+/**
+ * @brief Resets a handle's options and returns it to the pool.
+ *
+ * curl_easy_reset() keeps the handle's live connections, which is what makes
+ * the next request on this handle cheap.
+ *
+ * @param handle A handle obtained from acquire_handle().
+ */
+void HttpTransport::release_handle(CURL* handle)
+{
+    curl_easy_reset(handle);
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    idle_handles.push_back(handle);
+}
+
+
+/**
+ * @brief Applies the request and the transport-wide options to a handle.
+ *
+ * Every request shares the DNS and TLS session caches, negotiates HTTP/2 over
+ * TLS when the server supports it, and accepts any compressed response encoding
+ * that libcurl can decode. If the request has a cancel flag, a progress callback
+ * is installed that aborts the transfer once the flag is raised.
+ *
+ * @param handle The handle to configure.
+ * @param request The request to send.
+ * @param response The response whose body receives the downloaded data.
+ */
+void HttpTransport::configure_handle(CURL* handle, const HttpRequest& request, HttpResponse& response)
+{
+    #ifdef _WIN32
+        std::string cert_path = std::filesystem::current_path().string() + "\\certs\\cacert.pem";
+        curl_easy_setopt(handle, CURLOPT_CAINFO, cert_path.c_str());
+    #endif
+
+    curl_easy_setopt(handle, CURLOPT_SHARE, share);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
+
+    curl_easy_setopt(handle, CURLOPT_URL, request.url.c_str());
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, request.timeout_seconds);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, request.connect_timeout_seconds);
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, request.headers);
+
+    if (request.cancel_flag) {
+        curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+        curl_easy_setopt(handle, CURLOPT_XFERINFODATA, request.cancel_flag);
+    }
+
+    if (request.is_post) {
+        curl_easy_setopt(handle, CURLOPT_POST, 1L);
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, static_cast<long>(request.body.size()));
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS, request.body.c_str());
+    }
+
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, &response.body);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, &response);
+}
+
+
+/**
+ * @brief Returns the value of a response header.
+ *
+ * @param name The header name in lower case, e.g. "retry-after".
+ *
+ * @return The header value, or an empty string if the header was not sent.
+ */
+std::string HttpResponse::get_header(const std::string& name) const
+{
+    auto it = headers.find(name);
+    return it != headers.end() ? it->second : "";
+}
+
+
+void HttpTransport::lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* user_data)
+{
+    static_cast<HttpTransport*>(user_data)->share_mutexes[data].lock();
+}
+
+
+void HttpTransport::unlock_share(CURL* handle, curl_lock_data data, void* user_data)
+{
+    static_cast<HttpTransport*>(user_data)->share_mutexes[data].unlock();
+}
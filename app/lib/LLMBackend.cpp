@@ -0,0 +1,96 @@
+#include "LLMBackend.hpp"
+#include <algorithm>
+#include <cctype>
+
+
+/**
+ * @brief Returns the URL of the OpenAI-compatible chat completions endpoint.
+ *
+ * The base URL is expected to end with the API version, e.g.
+ * "https://api.openai.com/v1" or "http://localhost:8080/v1".
+ */
+std::string LLMBackend::get_chat_completions_url() const
+{
+    std::string url = base_url;
+    while (!url.empty() && url.back() == '/') {
+        url.pop_back();
+    }
+    return url + "/chat/completions";
+}
+
+
+/**
+ * @brief Builds the authentication header for the given key.
+ *
+ * The auth_header template may contain an {api_key} placeholder, e.g.
+ * "Authorization: Bearer {api_key}" or "api-key: {api_key}". An empty template
+ * or an empty key means that no authentication header is sent, which is what
+ * most local inference servers expect.
+ *
+ * @param key The API key to insert.
+ *
+ * @return The header line, or an empty string if none should be sent.
+ */
+std::string LLMBackend::get_auth_header_line(const std::string &key) const
+{
+    if (auth_header.empty() || key.empty()) {
+        return "";
+    }
+
+    std::string line = auth_header;
+    const std::string placeholder = "{api_key}";
+    size_t pos = line.find(placeholder);
+    if (pos != std::string::npos) {
+        line.replace(pos, placeholder.size(), key);
+    }
+    return line;
+}
+
+
+/**
+ * @brief Returns the lower-cased host name of the base URL.
+ */
+std::string LLMBackend::get_host() const
+{
+    std::string host = base_url;
+
+    size_t scheme_end = host.find("://");
+    if (scheme_end != std::string::npos) {
+        host.erase(0, scheme_end + 3);
+    }
+
+    host = host.substr(0, host.find('/'));
+
+    if (!host.empty() && host.front() == '[') {
+        host = host.substr(1, host.find(']') - 1);
+    } else {
+        host = host.substr(0, host.find(':'));
+    }
+
+    std::transform(host.begin(), host.end(), host.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return host;
+}
+
+
+/**
+ * @brief Tells whether the backend runs on this machine.
+ *
+ * Local backends do not need an internet connection.
+ */
+bool LLMBackend::is_local() const
+{
+    const std::string host = get_host();
+    return host == "localhost" || host == "::1" || host.rfind("127.", 0) == 0;
+}
+
+
+/**
+ * @brief Tells whether requests should use the key embedded in the application.
+ *
+ * This is the case for the OpenAI API when no key has been configured.
+ */
+bool LLMBackend::uses_embedded_key() const
+{
+    return api_key.empty() && get_host() == "api.openai.com";
+}
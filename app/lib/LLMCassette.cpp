@@ -0,0 +1,303 @@
+#include "LLMCassette.hpp"
+#include "RetryPolicy.hpp"
+#include <glib.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+
+
+// Cassette layout: the magic below, the pinned vocabulary as a 32-bit entry count
+// followed by the 32-bit id, parent id and name length and the raw name of every
+// entry, then one record per response made of the 64-bit payload hash, the 32-bit
+// body length and the raw body, all in host byte order. Legacy cassettes have no
+// vocabulary section.
+static constexpr char CASSETTE_MAGIC[8] = {'A', 'F', 'S', 'C', 'A', 'S', '0', '2'};
+static constexpr char LEGACY_CASSETTE_MAGIC[8] = {'A', 'F', 'S', 'C', 'A', 'S', '0', '1'};
+
+
+/**
+ * @brief Opens a cassette of recorded LLM responses.
+ *
+ * In replay mode the recorded responses are loaded into memory. In record mode
+ * the existing records are loaded too, so a request is only written once, and
+ * the file is opened for appending. The header of a new cassette is written
+ * once its vocabulary is pinned, see pin_vocabulary().
+ *
+ * @param path The cassette file.
+ * @param mode Whether responses are recorded, replayed or neither.
+ * @param replay_latency The delay added to every replayed response.
+ */
+LLMCassette::LLMCassette(const std::string& path, Mode mode,
+                         std::chrono::milliseconds replay_latency)
+    : path(path),
+      mode(mode),
+      replay_latency(replay_latency)
+{
+    if (mode == Mode::Off) {
+        return;
+    }
+
+    load();
+
+    if (mode == Mode::Record) {
+        bool is_new = !std::filesystem::exists(path) || std::filesystem::file_size(path) == 0;
+        output.open(path, std::ios::binary | std::ios::app);
+        if (!output) {
+            g_printerr("Failed to open LLM cassette for recording: %s\n", path.c_str());
+        } else if (is_new) {
+            header_pending = true;
+        }
+    }
+}
+
+
+/**
+ * @brief Reads all complete records of the cassette file.
+ *
+ * A truncated last record, e.g. from an interrupted recording, is ignored.
+ */
+void LLMCassette::load()
+{
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        if (mode == Mode::Replay) {
+            g_printerr("LLM cassette not found: %s\n", path.c_str());
+        }
+        return;
+    }
+
+    char magic[sizeof(CASSETTE_MAGIC)];
+    if (!input.read(magic, sizeof(magic))) {
+        g_printerr("Not an LLM cassette: %s\n", path.c_str());
+        return;
+    }
+    if (std::memcmp(magic, LEGACY_CASSETTE_MAGIC, sizeof(magic)) == 0) {
+        legacy_format = true;
+    } else if (std::memcmp(magic, CASSETTE_MAGIC, sizeof(magic)) != 0) {
+        g_printerr("Not an LLM cassette: %s\n", path.c_str());
+        return;
+    } else {
+        uint32_t count;
+        if (!input.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+            return;
+        }
+        std::vector<CategoryVocabulary::Entry> entries;
+        for (uint32_t i = 0; i < count; ++i) {
+            int32_t id;
+            int32_t parent_id;
+            uint32_t length;
+            if (!input.read(reinterpret_cast<char*>(&id), sizeof(id)) ||
+                !input.read(reinterpret_cast<char*>(&parent_id), sizeof(parent_id)) ||
+                !input.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+                return;
+            }
+            std::string name(length, '\0');
+            if (!input.read(name.data(), length)) {
+                return;
+            }
+            entries.push_back({id, parent_id, std::move(name), 0});
+        }
+        vocabulary = std::move(entries);
+    }
+
+    while (true) {
+        uint64_t hash;
+        uint32_t length;
+        if (!input.read(reinterpret_cast<char*>(&hash), sizeof(hash)) ||
+            !input.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+            break;
+        }
+
+        std::string body(length, '\0');
+        if (!input.read(body.data(), length)) {
+            break;
+        }
+        responses[hash] = std::move(body);
+    }
+}
+
+
+/**
+ * @brief Retrieves the mode the cassette was opened in.
+ */
+LLMCassette::Mode LLMCassette::get_mode() const
+{
+    return mode;
+}
+
+
+/**
+ * @brief Retrieves the number of distinct responses on the cassette.
+ */
+size_t LLMCassette::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return responses.size();
+}
+
+
+/**
+ * @brief Looks up the recorded response body for a request payload.
+ *
+ * @param payload The JSON request body.
+ * @return The recorded HTTP response body, or std::nullopt if the request was not recorded.
+ */
+std::optional<std::string> LLMCassette::find(const std::string& payload) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = responses.find(hash_payload(payload));
+    if (it == responses.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+
+/**
+ * @brief Waits for the configured replay latency.
+ *
+ * @param cancel_flag The flag that aborts the wait when raised, or nullptr.
+ * @return false if the wait was cancelled, true otherwise.
+ */
+bool LLMCassette::simulate_latency(const std::atomic<bool>* cancel_flag) const
+{
+    if (replay_latency.count() <= 0) {
+        return !(cancel_flag && cancel_flag->load());
+    }
+    return RetryPolicy::wait(replay_latency, cancel_flag);
+}
+
+
+/**
+ * @brief Appends a response to the cassette, unless the request is already on it.
+ *
+ * Records are flushed right away, so a run that is stopped or crashes keeps
+ * everything recorded so far.
+ *
+ * @param payload The JSON request body.
+ * @param response_body The HTTP response body received for it.
+ */
+void LLMCassette::record(const std::string& payload, const std::string& response_body)
+{
+    if (mode != Mode::Record) {
+        return;
+    }
+
+    const uint64_t hash = hash_payload(payload);
+    const uint32_t length = static_cast<uint32_t>(response_body.size());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!output || !responses.emplace(hash, response_body).second) {
+        return;
+    }
+    if (header_pending) {
+        write_header();
+    }
+
+    output.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+    output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    output.write(response_body.data(), length);
+    output.flush();
+}
+
+
+/**
+ * @brief Pins the vocabulary that is offered to the model for the whole cassette.
+ *
+ * The offered vocabulary is part of every request payload, and the answers
+ * refer to its entries by id. The live vocabulary changes with every confirmed
+ * categorization, so the cassette keeps the one that was offered when it was
+ * first recorded. Recording more requests and replaying them both offer that
+ * vocabulary again, which keeps the payloads, and with them the cassette keys,
+ * stable however the database has moved on. Legacy cassettes, recorded before
+ * the vocabulary was pinned, offer the live vocabulary.
+ *
+ * @param offered The vocabulary the caller would offer, see CategoryVocabulary::get_most_used().
+ * @return The vocabulary to offer instead.
+ */
+std::vector<CategoryVocabulary::Entry>
+LLMCassette::pin_vocabulary(const std::vector<CategoryVocabulary::Entry>& offered)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mode == Mode::Off || legacy_format) {
+        return offered;
+    }
+
+    if (!vocabulary) {
+        if (mode == Mode::Replay) {
+            return offered;
+        }
+        vocabulary = offered;
+        if (header_pending) {
+            write_header();
+        }
+    }
+    return *vocabulary;
+}
+
+
+/**
+ * @brief Writes the magic and the pinned vocabulary at the start of a new cassette.
+ *
+ * A cassette that records a response before any vocabulary was pinned pins an empty one.
+ */
+void LLMCassette::write_header()
+{
+    if (!vocabulary) {
+        vocabulary.emplace();
+    }
+
+    output.write(CASSETTE_MAGIC, sizeof(CASSETTE_MAGIC));
+    const uint32_t count = static_cast<uint32_t>(vocabulary->size());
+    output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& entry : *vocabulary) {
+        const int32_t id = entry.id;
+        const int32_t parent_id = entry.parent_id;
+        const uint32_t length = static_cast<uint32_t>(entry.name.size());
+        output.write(reinterpret_cast<const char*>(&id), sizeof(id));
+        output.write(reinterpret_cast<const char*>(&parent_id), sizeof(parent_id));
+        output.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        output.write(entry.name.data(), length);
+    }
+    output.flush();
+    header_pending = false;
+}
+
+
+/**
+ * @brief Parses a cassette mode from the configuration file.
+ *
+ * @param value "record" or "replay", in any case. Anything else turns the cassette off.
+ */
+LLMCassette::Mode LLMCassette::parse_mode(const std::string& value)
+{
+    std::string lower = value;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    if (lower == "record") {
+        return Mode::Record;
+    }
+    if (lower == "replay") {
+        return Mode::Replay;
+    }
+    return Mode::Off;
+}
+
+
+/**
+ * @brief Hashes a request payload with 64-bit FNV-1a.
+ *
+ * The payload contains the model, the prompt, the offered vocabulary and the
+ * file names, so equal hashes mean equal requests.
+ */
+uint64_t LLMCassette::hash_payload(const std::string& payload)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : payload) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
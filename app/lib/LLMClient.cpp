@@ -1,9 +1,7 @@
 #include "LLMClient.hpp"
 #include "Types.hpp"
 #include "Utils.hpp"
-#include <curl/curl.h>
 #include <glib.h>
-#include <filesystem>
 #ifdef _WIN32
     #include <json/json.h>
 #elif __APPLE__
@@ -12,95 +10,423 @@
     #include <jsoncpp/json/json.h>
 #endif
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
 
-// Helper function to write the response from curl into a string
-static size_t WriteCallback(void *contents, size_t size, size_t nmemb, std::string *response)
+static const std::string CATEGORIZATION_GUIDELINES =
+    "You are a file categorization assistant. If it's an installer, give what category the software "
+    "falls into after installation. Category must be relevant to file extension general type (e.g., PDF, "
+    "MD, TXT files have one general type). Always return the category of a file or directory name in one "
+    "or two words, plural. Also give subcategory where appropriate. Subcategory must be relevant to "
+    "probable file contents.";
+
+static const std::string BATCH_INSTRUCTIONS =
+    " You will receive a JSON array of entries, each with an \"id\", a \"name\" and a \"type\" "
+    "(file or directory). Some entries also have a \"content\" field with the file type detected "
+    "from the file contents; trust it over the name when they disagree. Reply with a JSON object only, "
+    "{\"results\": [...]}, whose array contains one object per entry in the form "
+    "{\"id\": <id>, \"name\": <name>, \"category\": <category>, \"subcategory\": <subcategory>, "
+    "\"confidence\": <how sure you are of the category, from 0 to 1>}. "
+    "Do not add any other text.";
+
+// Longest category or subcategory name accepted from the model
+static constexpr size_t MAX_NAME_LENGTH = 64;
+static constexpr int MAX_NAME_WORDS = 5;
+
+
+/**
+ * Builds the response_format that makes the backend answer batch requests
+ * with JSON matching the expected schema.
+ */
+static Json::Value make_response_format()
 {
-    size_t totalSize = size * nmemb;
-    response->append((char *)contents, totalSize);
-    return totalSize;
+    Json::Value string_type;
+    string_type["type"] = "string";
+
+    Json::Value item;
+    item["type"] = "object";
+    item["properties"]["id"]["type"] = "integer";
+    item["properties"]["name"] = string_type;
+    item["properties"]["category"] = string_type;
+    item["properties"]["subcategory"] = string_type;
+    item["properties"]["confidence"]["type"] = "number";
+    for (const char* key : {"id", "name", "category", "subcategory", "confidence"}) {
+        item["required"].append(key);
+    }
+    item["additionalProperties"] = false;
+
+    Json::Value schema;
+    schema["type"] = "object";
+    schema["properties"]["results"]["type"] = "array";
+    schema["properties"]["results"]["items"] = item;
+    schema["required"].append("results");
+    schema["additionalProperties"] = false;
+
+    Json::Value response_format;
+    response_format["type"] = "json_schema";
+    response_format["json_schema"]["name"] = "file_categorizations";
+    response_format["json_schema"]["strict"] = true;
+    response_format["json_schema"]["schema"] = schema;
+    return response_format;
 }
 
 
 /**
- * @brief Constructs an LLMClient object with a given API key.
+ * @brief Constructs an LLMClient object for an OpenAI-compatible backend.
  * 
- * @param api_key The API key to use for authenticating requests to the OpenAI API.
+ * @param backend The endpoint, model, auth header template and timeout to use.
+ * @param api_key The API key to use for authenticating requests, or an empty
+ *                string for backends that do not need one.
  * 
+ * The request headers are built once here and reused by every request.
+ */
+LLMClient::LLMClient(const LLMBackend &backend, const std::string &api_key)
+    : backend(backend),
+      api_key(api_key)
+{
+    std::vector<std::string> header_lines = {"Content-Type: application/json"};
+
+    std::string auth_line = backend.get_auth_header_line(api_key);
+    if (!auth_line.empty()) {
+        header_lines.push_back(auth_line);
+    }
+
+    headers = HttpTransport::make_header_list(header_lines);
+}
+
+
+/**
+ * @brief Sets the flag that cancels in-flight requests when raised.
+ *
+ * @param flag The flag to watch, typically MainApp::stop_analysis. It must
+ *             outlive every request made by this client.
+ */
+void LLMClient::set_cancel_flag(const std::atomic<bool>* flag)
+{
+    cancel_flag = flag;
+}
+
+
+/**
+ * @brief Shares a rate limiter between this client and others.
+ *
+ * Every request first takes one request and its estimated tokens from the
+ * limiter, and the limiter is kept in line with the x-ratelimit-* headers.
+ *
+ * @param limiter The limiter to use, or nullptr to send requests unthrottled.
+ */
+void LLMClient::set_rate_limiter(std::shared_ptr<RateLimiter> limiter)
+{
+    rate_limiter = std::move(limiter);
+}
+
+
+/**
+ * @brief Sets the policy that decides how failed requests are retried.
+ *
+ * @param policy The retry policy to use.
+ */
+void LLMClient::set_retry_policy(const RetryPolicy& policy)
+{
+    retry_policy = policy;
+}
+
+
+/**
+ * @brief Sets the cassette used to record or replay responses.
+ *
+ * In record mode every successful response is written to the cassette. In
+ * replay mode requests are answered from the cassette and never reach the network.
+ *
+ * @param cassette The cassette to use, or nullptr to always use the network.
+ */
+void LLMClient::set_cassette(std::shared_ptr<LLMCassette> cassette)
+{
+    this->cassette = std::move(cassette);
+}
+
+
+/**
+ * @brief Sets the tracker that accounts for the tokens, retries and latency of every request.
+ *
+ * @param tracker The tracker to report to, or nullptr to disable accounting.
+ */
+void LLMClient::set_usage_tracker(std::shared_ptr<LLMUsageTracker> tracker)
+{
+    usage_tracker = std::move(tracker);
+}
+
+
+/**
+ * @brief Shares a circuit breaker that makes requests fail fast while the endpoint is down.
+ *
+ * Requests refused by the breaker throw LLMUnavailableError without touching
+ * the network. Network errors and 5xx responses count as failures.
+ *
+ * @param breaker The breaker to use, or nullptr to always try the network.
+ */
+void LLMClient::set_circuit_breaker(std::shared_ptr<CircuitBreaker> breaker)
+{
+    circuit_breaker = std::move(breaker);
+}
+
+
+/**
+ * @brief Offers the existing categories to the model in batch requests.
+ *
+ * The categories and subcategories are listed with their vocabulary ids, and
+ * the model is asked to answer with the ids of the ones that fit. That keeps
+ * answers short and avoids near-synonyms of existing categories.
+ *
+ * @param entries The vocabulary entries to offer, each category followed by
+ *                its subcategories, see CategoryVocabulary::get_most_used().
+ */
+void LLMClient::set_vocabulary(const std::vector<CategoryVocabulary::Entry>& entries)
+{
+    vocabulary_names.clear();
+    vocabulary_prompt.clear();
+
+    std::string listing;
+    bool in_subcategories = false;
+    for (const auto& entry : entries) {
+        vocabulary_names[entry.id] = entry.name;
+
+        if (entry.parent_id == 0) {
+            listing += in_subcategories ? "]; " : (listing.empty() ? "" : "; ");
+            in_subcategories = false;
+        } else {
+            listing += in_subcategories ? ", " : " [";
+            in_subcategories = true;
+        }
+        listing += std::to_string(entry.id) + " " + entry.name;
+    }
+    if (in_subcategories) {
+        listing += "]";
+    }
+
+    if (!listing.empty()) {
+        vocabulary_prompt =
+            " Existing categories are listed below as <number> <name>, each followed by its "
+            "subcategories in brackets. When one fits, answer with its number instead of its name in "
+            "\"category\" or \"subcategory\". Use a new name only when none fits. " + listing + ".";
+    }
+}
+
+
+/**
+ * @brief Sends a request, retrying network errors and retryable statuses.
+ *
+ * Every attempt first takes capacity from the rate limiter, if one is set.
+ * Waits between attempts follow the retry policy and any delay the server asked for.
+ * Network errors are no longer retried once the circuit breaker has opened,
+ * e.g. because requests of other workers failed in the meantime.
+ *
+ * @param request The request to send.
+ * @param estimated_tokens The number of tokens the request is expected to use.
+ * @param attempts Set to the number of attempts made.
+ *
+ * @return The last response received.
  */
-LLMClient::LLMClient(const std::string &api_key) : api_key(api_key)
-{}
+HttpResponse LLMClient::perform_with_retries(const HttpRequest& request, double estimated_tokens, int& attempts)
+{
+    HttpResponse response;
+
+    for (int attempt = 1; ; ++attempt) {
+        attempts = attempt;
+        if (rate_limiter && !rate_limiter->acquire(estimated_tokens, cancel_flag)) {
+            throw std::runtime_error("Cancelled: The request was cancelled.");
+        }
+
+        try {
+            response = HttpTransport::shared().perform(request);
+        } catch (const std::exception& ex) {
+            if ((cancel_flag && cancel_flag->load()) || attempt >= retry_policy.get_max_attempts()) {
+                throw;
+            }
+            if (circuit_breaker && circuit_breaker->is_open()) {
+                throw LLMUnavailableError(std::string("Unavailable: ") + ex.what());
+            }
+            g_printerr("Attempt %d failed, retrying: %s\n", attempt, ex.what());
+            if (!RetryPolicy::wait(retry_policy.next_delay(attempt), cancel_flag)) {
+                throw std::runtime_error("Cancelled: The request was cancelled.");
+            }
+            continue;
+        }
+
+        if (rate_limiter) {
+            rate_limiter->update_from_headers(response);
+        }
+
+        if (!RetryPolicy::is_retryable_status(response.status_code) ||
+            attempt >= retry_policy.get_max_attempts()) {
+            break;
+        }
+
+        auto delay = retry_policy.next_delay(attempt, &response);
+        if (response.status_code == 429 && rate_limiter) {
+            rate_limiter->pause_for(delay);
+        }
+
+        g_printerr("Attempt %d returned status %ld, retrying in %lld ms\n",
+                   attempt, response.status_code, static_cast<long long>(delay.count()));
+        if (!RetryPolicy::wait(delay, cancel_flag)) {
+            throw std::runtime_error("Cancelled: The request was cancelled.");
+        }
+    }
+
+
+    return response;
+}
 
 
 /**
- * @brief Sends a POST request to the OpenAI API with a JSON payload.
+ * @brief Serves a request from the cassette instead of the network.
+ *
+ * The configured replay latency is applied first, so replayed runs can
+ * approximate the timing of the real API.
+ *
+ * @param json_payload The JSON request body.
+ *
+ * @return A 200 response carrying the recorded body.
+ */
+HttpResponse LLMClient::replay_from_cassette(const std::string& json_payload)
+{
+    std::optional<std::string> body = cassette->find(json_payload);
+    if (!body) {
+        throw std::runtime_error("Cassette Error: No recorded response for this request.");
+    }
+
+    if (!cassette->simulate_latency(cancel_flag)) {
+        throw std::runtime_error("Cancelled: The request was cancelled.");
+    }
+
+    HttpResponse response;
+    response.status_code = 200;
+    response.body = std::move(*body);
+    return response;
+}
+
+
+/**
+ * @brief Sends a POST request to the backend's chat completions endpoint.
+ *
+ * Network errors, timeouts, rate limiting (429) and transient server errors are
+ * retried according to the retry policy, waiting for the delay requested by the
+ * server when there is one. A 429 also pauses the shared rate limiter, so the
+ * other workers slow down instead of hitting the same limit. When a cassette
+ * is set, responses are recorded to it or replayed from it. Every request,
+ * successful or not, is reported to the usage tracker if one is set.
  * 
  * @param json_payload The JSON payload to be sent in the request body.
+ * @param timeout_seconds The maximum time a single attempt may take.
  * 
- * @return The category string returned in the response body.
+ * @return The message content returned in the response body.
  * 
- * @exception std::runtime_error If there is an error with the request or the response.
- */
-std::string LLMClient::send_api_request(std::string json_payload) {
-    CURL *curl;
-    CURLcode res;
-    std::string response_string;
-    std::string api_url = "https://api.openai.com/v1/chat/completions";
-
-    curl = curl_easy_init();
-    if (!curl) {
-        throw std::runtime_error("Initialization Error: Failed to initialize cURL.");
-    }
-
-    #ifdef _WIN32
-        std::string cert_path = std::filesystem::current_path().string() + "\\certs\\cacert.pem";
-        curl_easy_setopt(curl, CURLOPT_CAINFO, cert_path.c_str());
-    #endif
-    curl_easy_setopt(curl, CURLOPT_URL, api_url.c_str());
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, ("Authorization: Bearer " + api_key).c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_payload.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_string);
-
-    res = curl_easy_perform(curl);
-
-    if (res != CURLE_OK) {
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
-        throw std::runtime_error("Network Error: " + std::string(curl_easy_strerror(res)));
-    }
-
-    long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
+ * @exception LLMRequestError If the API answers with an error status.
+ * @exception std::runtime_error If the request was cancelled, or the response
+ *            cannot be used once all attempts are exhausted.
+ */
+std::string LLMClient::send_api_request(const std::string& json_payload, long timeout_seconds) {
+    HttpRequest request;
+    request.url = backend.get_chat_completions_url();
+    request.is_post = true;
+    request.body = json_payload;
+    request.headers = headers.get();
+    request.timeout_seconds = timeout_seconds;
+    request.cancel_flag = cancel_flag;
+
+    // Roughly four characters per token, plus room for the answer
+    const double estimated_tokens = static_cast<double>(json_payload.size()) / 4.0 + 512.0;
+    HttpResponse response;
+
+    const auto started = std::chrono::steady_clock::now();
+    LLMUsageTracker::RequestRecord usage;
+    usage.replayed = cassette && cassette->get_mode() == LLMCassette::Mode::Replay;
+
+    auto record_usage = [&]() {
+        if (usage_tracker) {
+            usage.latency_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - started).count();
+            usage_tracker->record(usage);
+        }
+    };
+
+    try {
+        if (usage.replayed) {
+            usage.attempts = 1;
+            response = replay_from_cassette(json_payload);
+        } else {
+            if (circuit_breaker && !circuit_breaker->allow_request()) {
+                throw LLMUnavailableError("Unavailable: The LLM endpoint is not reachable at the moment.");
+            }
+
+            try {
+                response = perform_with_retries(request, estimated_tokens, usage.attempts);
+            } catch (const LLMUnavailableError&) {
+                throw;
+            } catch (const std::exception&) {
+                if (circuit_breaker && !(cancel_flag && cancel_flag->load())) {
+                    circuit_breaker->record_failure();
+                }
+                throw;
+            }
+
+            if (circuit_breaker) {
+                if (response.status_code >= 500) {
+                    circuit_breaker->record_failure();
+                } else {
+                    circuit_breaker->record_success();
+                }
+            }
+
+            if (cassette && response.status_code == 200) {
+                cassette->record(json_payload, response.body);
+            }
+        }
+    } catch (...) {
+        record_usage();
+        throw;
+    }
+
+    long http_code = response.status_code;
 
     Json::CharReaderBuilder reader_builder;
     Json::Value root;
-    std::istringstream response_stream(response_string);
+    std::istringstream response_stream(response.body);
     std::string errors;
-    
-    if (!Json::parseFromStream(reader_builder, response_stream, &root, &errors)) {
-        throw std::runtime_error("Response Error: Failed to parse JSON response. " + errors);
+    bool parsed = Json::parseFromStream(reader_builder, response_stream, &root, &errors);
+
+    usage.status_code = http_code;
+    if (parsed) {
+        usage.prompt_tokens = root["usage"]["prompt_tokens"].asInt64();
+        usage.completion_tokens = root["usage"]["completion_tokens"].asInt64();
     }
+    record_usage();
 
     if (http_code == 401) {
-        throw std::runtime_error("Authentication Error: Invalid or missing API key.");
+        throw LLMRequestError("Authentication Error: Invalid or missing API key.", http_code);
     } else if (http_code == 403) {
-        throw std::runtime_error("Authorization Error: API key does not have sufficient permissions.");
+        throw LLMRequestError("Authorization Error: API key does not have sufficient permissions.", http_code);
+    } else if (http_code == 429) {
+        throw LLMRequestError("Rate Limit Error: Too many requests, even after retrying.", http_code);
     } else if (http_code >= 500) {
-        throw std::runtime_error("Server Error: OpenAI server returned an error. Status code: " + std::to_string(http_code));
+        throw LLMRequestError("Server Error: The LLM server returned an error. Status code: " + std::to_string(http_code), http_code);
     } else if (http_code >= 400) {
-        std::string error_message = root["error"]["message"].asString();
-        throw std::runtime_error("Client Error: " + error_message);
+        std::string error_message = parsed ? root["error"]["message"].asString() : "Status code: " + std::to_string(http_code);
+        throw LLMRequestError("Client Error: " + error_message, http_code);
+    }
+
+    if (!parsed) {
+        throw std::runtime_error("Response Error: Failed to parse JSON response. " + errors);
+    }
+
+    if (rate_limiter && !usage.replayed && root["usage"]["total_tokens"].isNumeric()) {
+        rate_limiter->release_unused(estimated_tokens - root["usage"]["total_tokens"].asDouble());
     }
 
     std::string category = root["choices"][0]["message"]["content"].asString();
@@ -109,49 +435,368 @@ std::string LLMClient::send_api_request(std::string json_payload) {
 
 
 /**
- * Sends a categorization request to the OpenAI API and returns the response as a category name.
+ * Categorizes several files or directories with as few API requests as possible.
+ *
+ * All entries are packed into a single chat request that asks for a JSON array of
+ * {id, name, category, subcategory, confidence} objects. Answers are mapped back to the inputs
+ * by id (falling back to the name), and only the entries whose answers are missing
+ * or were rejected by validation are sent again, up to max_batch_attempts requests
+ * in total. How every reply could be parsed is reported to the usage tracker.
  *
- * @param file_name The name of the file or directory to be categorized.
- * @param file_type The type of file, either FileType::File or FileType::Directory.
+ * @param entries The files or directories to be categorized.
  *
- * @return A string representing the category name assigned by the AI.
+ * @return One element per input entry, in input order. An element is empty if no
+ *         valid categorization was received for that entry.
+ *
+ * @exception std::runtime_error If a request fails at the network or HTTP level before
+ *            any entry was answered. A failure on a later attempt ends the retries and
+ *            the answers received so far are returned.
  */
-std::string LLMClient::categorize_file(const std::string& file_name, FileType file_type)
+std::vector<std::optional<Categorization>>
+LLMClient::categorize_files(std::span<const FileEntry> entries)
 {
-    std::string json_payload = make_payload(file_name, file_type);
+    std::vector<std::optional<Categorization>> results(entries.size());
+    std::vector<size_t> pending(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        pending[i] = i;
+    }
 
-    return send_api_request(json_payload);
+    for (int attempt = 0; attempt < max_batch_attempts && !pending.empty(); ++attempt) {
+        std::string json_payload = make_batch_payload(entries, pending);
+        long timeout_seconds = backend.timeout_seconds + static_cast<long>(pending.size());
+        std::string content;
+        try {
+            content = send_api_request(json_payload, timeout_seconds);
+        } catch (const std::exception&) {
+            // Keep the answers of earlier attempts; the caller retries only the missing entries
+            if (pending.size() == entries.size()) {
+                throw;
+            }
+            break;
+        }
+
+        auto outcome = parse_batch_response(content, entries, pending, results);
+        if (usage_tracker) {
+            usage_tracker->record_parse(outcome);
+        }
+
+        std::erase_if(pending, [&results](size_t index) { return results[index].has_value(); });
+    }
+
+    return results;
 }
 
 
 /**
- * Creates a JSON payload for sending a categorization request to the OpenAI API.
+ * Creates a JSON payload that asks for the categorization of several entries at once.
  *
- * @param file_name The name of the file or directory to be categorized.
- * @param file_type The type of file, either FileType::File or FileType::Directory.
+ * @param entries All entries of the batch.
+ * @param indices The positions in entries that should be part of this request. They are
+ *                sent as ids so that answers can be mapped back to the inputs.
  *
  * @return A JSON string representing the payload to be sent to the API.
  */
-std::string LLMClient::make_payload(const std::string& file_name, const FileType file_type)
+std::string LLMClient::make_batch_payload(std::span<const FileEntry> entries,
+                                          const std::vector<size_t>& indices)
 {
-    std::string prompt;
+    Json::Value items(Json::arrayValue);
+    for (size_t index : indices) {
+        Json::Value item;
+        item["id"] = static_cast<Json::UInt64>(index);
+        item["name"] = entries[index].file_name;
+        item["type"] = (entries[index].type == FileType::File) ? "file" : "directory";
+        if (!entries[index].content_type.empty()) {
+            item["content"] = entries[index].content_type;
+        }
+        items.append(item);
+    }
+
+    Json::StreamWriterBuilder writer_builder;
+    writer_builder["indentation"] = "";
+
+    Json::Value root;
+    root["model"] = backend.model;
+
+    Json::Value system_message;
+    system_message["role"] = "system";
+    system_message["content"] = CATEGORIZATION_GUIDELINES + BATCH_INSTRUCTIONS + vocabulary_prompt;
 
-    if (file_type == FileType::File) {
-        // g_print("File name: %s\n", file_name.c_str());
-        prompt = "Categorize file: " + file_name;
+    if (backend.structured_output) {
+        root["response_format"] = make_response_format();
+    }
+
+    Json::Value user_message;
+    user_message["role"] = "user";
+    user_message["content"] = Json::writeString(writer_builder, items);
+
+    root["messages"].append(system_message);
+    root["messages"].append(user_message);
+
+    return Json::writeString(writer_builder, root);
+}
+
+
+/**
+ * Reads the confidence the model gave for an answer.
+ *
+ * Percentages are scaled down to the 0 to 1 range. An answer without a usable
+ * confidence is taken at face value, so backends that ignore the field are
+ * never escalated for it.
+ *
+ * @param value The "confidence" member of an answer.
+ *
+ * @return The confidence, between 0 and 1.
+ */
+double LLMClient::parse_confidence(const Json::Value& value)
+{
+    double confidence = 1.0;
+    if (value.isNumeric()) {
+        confidence = value.asDouble();
+    } else if (value.isString()) {
+        try {
+            confidence = std::stod(value.asString());
+        } catch (const std::exception&) {
+            return 1.0;
+        }
     } else {
-        // g_print("Directory name: %s\n", file_name.c_str());
-        prompt = "Categorize directory: " + file_name;
-    }
-
-    std::string json_payload = R"(
-    {
-        "model": "gpt-4o-mini",
-        "messages": [
-            {"role": "system", "content": "You are a file categorization assistant. If it's an installer, give what category the software falls into after installation. Category must be relevant to file extension general type (e.g., PDF, MD, TXT files have one general type). Always return the category of a file or directory name in one or two words, plural. Also give subcategory where appropriate. Subcategory must be relevant to probable file contents. The format is Category : Subcategory."},
-            {"role": "user", "content": ")" + prompt + R"("}
-        ]
-    })";
-    
-    return json_payload;
-}
\ No newline at end of file
+        return 1.0;
+    }
+
+    if (confidence > 1.0 && confidence <= 100.0) {
+        confidence /= 100.0;
+    }
+    return std::clamp(confidence, 0.0, 1.0);
+}
+
+
+/**
+ * Extracts the array of answers from the reply to a batch request.
+ *
+ * Structured replies are a {"results": [...]} object. Backends without
+ * structured output may answer with a bare array, possibly wrapped in a
+ * Markdown code fence or surrounded by text, so the outermost array of the
+ * reply is tried next.
+ *
+ * @param content The message content returned by the API.
+ *
+ * @return The answers, or a null value if the reply contains no usable array.
+ */
+Json::Value LLMClient::extract_answers(const std::string& content)
+{
+    Json::CharReaderBuilder reader_builder;
+    std::unique_ptr<Json::CharReader> reader(reader_builder.newCharReader());
+    Json::Value root;
+    std::string errors;
+
+    if (reader->parse(content.data(), content.data() + content.size(), &root, &errors)) {
+        if (root.isObject() && root["results"].isArray()) {
+            return root["results"];
+        }
+        if (root.isArray()) {
+            return root;
+        }
+    }
+
+    size_t begin = content.find('[');
+    size_t end = content.rfind(']');
+    if (begin == std::string::npos || end == std::string::npos || end < begin) {
+        g_printerr("Batch response does not contain a JSON array\n");
+        return Json::Value();
+    }
+
+    if (!reader->parse(content.data() + begin, content.data() + end + 1, &root, &errors) || !root.isArray()) {
+        g_printerr("Failed to parse batch response: %s\n", errors.c_str());
+        return Json::Value();
+    }
+
+    return root;
+}
+
+
+/**
+ * Checks a categorization proposed by the model, repairing what can be repaired.
+ *
+ * Surrounding quotes, backticks, asterisks and trailing punctuation are removed,
+ * and a "Category : Subcategory" text in the category field is split. A category
+ * that is empty, too long, has too many words, control characters, backslashes
+ * or braces, or is a placeholder such as "null", is rejected. An unacceptable
+ * subcategory is dropped, keeping the category.
+ *
+ * @param answer The categorization to check, repaired in place.
+ *
+ * @return Whether the answer was valid as it was, repaired, or rejected.
+ */
+LLMClient::AnswerCheck LLMClient::validate_categorization(Categorization& answer)
+{
+    bool repaired = false;
+
+    auto clean = [&repaired](std::string& name) {
+        static const char* junk = " \t\r\n\"'`*";
+        std::string cleaned;
+        size_t first = name.find_first_not_of(junk);
+        if (first != std::string::npos) {
+            cleaned = name.substr(first, name.find_last_not_of(junk) - first + 1);
+        }
+        while (!cleaned.empty() && cleaned.back() != '\0' && std::strchr(".,;: \t", cleaned.back())) {
+            cleaned.pop_back();
+        }
+        if (cleaned != name) {
+            name = std::move(cleaned);
+            repaired = true;
+        }
+    };
+
+    if (answer.subcategory.empty()) {
+        size_t separator = answer.category.find(':');
+        if (separator != std::string::npos && separator + 1 < answer.category.size()) {
+            answer.subcategory = answer.category.substr(separator + 1);
+            answer.category.erase(separator);
+            repaired = true;
+        }
+    }
+
+    clean(answer.category);
+    clean(answer.subcategory);
+
+    auto is_acceptable = [](const std::string& name) {
+        if (name.empty() || name.size() > MAX_NAME_LENGTH) {
+            return false;
+        }
+        if (std::any_of(name.begin(), name.end(), [](unsigned char c) {
+                return c < 0x20 || c == '\\' || c == '{' || c == '}' || c == '<' || c == '>';
+            })) {
+            return false;
+        }
+        if (std::count(name.begin(), name.end(), ' ') >= MAX_NAME_WORDS) {
+            return false;
+        }
+
+        std::string lowered = name;
+        std::transform(lowered.begin(), lowered.end(), lowered.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        return lowered != "null" && lowered != "none" && lowered != "n/a" &&
+               lowered != "category" && lowered != "subcategory";
+    };
+
+    if (!is_acceptable(answer.category)) {
+        return AnswerCheck::Rejected;
+    }
+    if (!answer.subcategory.empty() && !is_acceptable(answer.subcategory)) {
+        answer.subcategory.clear();
+        repaired = true;
+    }
+
+    return repaired ? AnswerCheck::Repaired : AnswerCheck::Valid;
+}
+
+
+/**
+ * Parses the reply to a batch request and stores every valid answer in results.
+ *
+ * Each answer is matched to a requested entry by its id, or by its name if the
+ * id is missing or does not belong to the request, and then validated. Answers
+ * that cannot be matched or are rejected are ignored, so the corresponding
+ * entries stay empty and are asked for again.
+ *
+ * @param content The message content returned by the API.
+ * @param entries All entries of the batch.
+ * @param indices The positions in entries that were part of the request.
+ * @param results The per-entry results to fill in.
+ *
+ * @return How many answers were accepted, repaired and rejected.
+ */
+LLMUsageTracker::ParseOutcome LLMClient::parse_batch_response(const std::string& content,
+                                                              std::span<const FileEntry> entries,
+                                                              const std::vector<size_t>& indices,
+                                                              std::vector<std::optional<Categorization>>& results)
+{
+    LLMUsageTracker::ParseOutcome outcome;
+    outcome.expected = indices.size();
+
+    Json::Value answers = extract_answers(content);
+    if (!answers.isArray()) {
+        outcome.malformed = true;
+        return outcome;
+    }
+
+    auto is_requested = [&indices](size_t index) {
+        return std::find(indices.begin(), indices.end(), index) != indices.end();
+    };
+
+    // Vocabulary answers are numbers, possibly quoted; anything else is a new name
+    auto resolve_name = [this](const Json::Value& value) -> std::string {
+        if (value.isInt()) {
+            auto it = vocabulary_names.find(value.asInt());
+            return it == vocabulary_names.end() ? std::string() : it->second;
+        }
+        // Numbers that are no vocabulary id, e.g. beyond the range of int, are unknown
+        if (!value.isString()) {
+            return "";
+        }
+        std::string text = value.asString();
+        if (!text.empty() && text.size() < 10 && std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            auto it = vocabulary_names.find(std::stoi(text));
+            return it == vocabulary_names.end() ? std::string() : it->second;
+        }
+        return text;
+    };
+
+    std::vector<size_t> rejected;
+
+    for (const auto& item : answers) {
+        if (!item.isObject()) {
+            continue;
+        }
+
+        std::optional<size_t> index;
+        if (item["id"].isUInt64()) {
+            size_t id = static_cast<size_t>(item["id"].asLargestUInt());
+            if (id < entries.size() && is_requested(id)) {
+                index = id;
+            }
+        }
+
+        if (!index && item["name"].isString()) {
+            const std::string name = item["name"].asString();
+            auto it = std::find_if(indices.begin(), indices.end(), [&](size_t i) {
+                return entries[i].file_name == name && !results[i].has_value();
+            });
+            if (it != indices.end()) {
+                index = *it;
+            }
+        }
+
+        if (!index || results[*index].has_value()) {
+            continue;
+        }
+
+        Categorization answer{resolve_name(item["category"]),
+                              resolve_name(item["subcategory"]),
+                              parse_confidence(item["confidence"])};
+
+        switch (validate_categorization(answer)) {
+            case AnswerCheck::Valid:
+                ++outcome.accepted;
+                break;
+            case AnswerCheck::Repaired:
+                ++outcome.repaired;
+                break;
+            case AnswerCheck::Rejected:
+                if (std::find(rejected.begin(), rejected.end(), *index) == rejected.end()) {
+                    rejected.push_back(*index);
+                }
+                continue;
+        }
+
+        results[*index] = std::move(answer);
+    }
+
+    // An entry rejected once but answered validly later in the reply is not a rejection
+    outcome.rejected = std::count_if(rejected.begin(), rejected.end(),
+                                     [&results](size_t index) { return !results[index].has_value(); });
+    if (outcome.rejected > 0) {
+        g_printerr("Rejected %zu malformed answers, asking again\n", outcome.rejected);
+    }
+
+    return outcome;
+}
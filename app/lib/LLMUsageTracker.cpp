@@ -0,0 +1,272 @@
+#include "LLMUsageTracker.hpp"
+#include <glib.h>
+#ifdef _WIN32
+    #include <json/json.h>
+#elif __APPLE__
+    #include <json/json.h>
+#else
+    #include <jsoncpp/json/json.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+
+
+// Upper bounds of the latency histogram buckets in the JSON dump, in milliseconds
+static const double LATENCY_BUCKETS_MS[] = {250, 500, 1000, 2000, 4000, 8000, 16000, 32000, 64000};
+
+
+/**
+ * @brief Starts the accounting for one analysis run.
+ *
+ * @param model The model the requests are sent to, for the reports.
+ * @param prompt_price_per_million The price of one million prompt tokens.
+ * @param completion_price_per_million The price of one million completion tokens.
+ */
+LLMUsageTracker::LLMUsageTracker(const std::string &model,
+                                 double prompt_price_per_million,
+                                 double completion_price_per_million)
+    : model(model),
+      prompt_price_per_million(prompt_price_per_million),
+      completion_price_per_million(completion_price_per_million),
+      started(Clock::now()),
+      started_wall(std::chrono::system_clock::now())
+{}
+
+
+/**
+ * @brief Records one LLM request, including all of its attempts.
+ *
+ * Safe to call from several worker threads.
+ *
+ * @param request The outcome of the request. A status code of 0 means no
+ *                response was received, e.g. after a network error or cancellation.
+ */
+void LLMUsageTracker::record(const RequestRecord &request)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    requests.push_back(request);
+}
+
+
+/**
+ * @brief Records how well the reply to one batch request could be parsed.
+ *
+ * Safe to call from several worker threads.
+ *
+ * @param outcome The number of answers expected, accepted as they were,
+ *                repaired and rejected, and whether the reply was unusable as a whole.
+ */
+void LLMUsageTracker::record_parse(const ParseOutcome &outcome)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    parses.push_back(outcome);
+}
+
+
+/**
+ * @brief Aggregates the requests recorded so far.
+ *
+ * @return The totals, the estimated cost, the latency percentiles and the
+ *         parse failures of the run.
+ */
+LLMUsageTracker::Summary LLMUsageTracker::summarize() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Summary summary;
+    std::vector<double> latencies;
+    latencies.reserve(requests.size());
+
+    for (const auto &request : requests) {
+        ++summary.requests;
+        if (request.status_code != 200) {
+            ++summary.failed_requests;
+        }
+        summary.retries += std::max(0, request.attempts - 1);
+        summary.prompt_tokens += request.prompt_tokens;
+        summary.completion_tokens += request.completion_tokens;
+        summary.total_latency_ms += request.latency_ms;
+        latencies.push_back(request.latency_ms);
+    }
+
+    for (const auto &parse : parses) {
+        ++summary.parsed_responses;
+        if (parse.malformed) {
+            ++summary.malformed_responses;
+        }
+        summary.answers_accepted += parse.accepted;
+        summary.answers_repaired += parse.repaired;
+        summary.answers_rejected += parse.rejected;
+        summary.answers_missing += parse.expected - std::min(parse.expected,
+                                                             parse.accepted + parse.repaired + parse.rejected);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    summary.p50_ms = percentile(latencies, 0.50);
+    summary.p95_ms = percentile(latencies, 0.95);
+    summary.p99_ms = percentile(latencies, 0.99);
+    summary.max_ms = latencies.empty() ? 0.0 : latencies.back();
+
+    summary.cost = summary.prompt_tokens * prompt_price_per_million / 1e6 +
+                   summary.completion_tokens * completion_price_per_million / 1e6;
+    summary.elapsed_seconds = std::chrono::duration<double>(Clock::now() - started).count();
+
+    return summary;
+}
+
+
+/**
+ * @brief Computes a nearest-rank percentile.
+ *
+ * @param sorted_values The values, in ascending order.
+ * @param fraction The percentile as a fraction, e.g. 0.95.
+ * @return The percentile, or 0 if there are no values.
+ */
+double LLMUsageTracker::percentile(const std::vector<double> &sorted_values, double fraction)
+{
+    if (sorted_values.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted_values.size()));
+    return sorted_values[std::clamp<size_t>(rank, 1, sorted_values.size()) - 1];
+}
+
+
+/**
+ * @brief Formats the run summary for the progress dialog.
+ */
+std::string LLMUsageTracker::format_summary() const
+{
+    Summary summary = summarize();
+
+    char text[768];
+    std::snprintf(text, sizeof(text),
+                  "LLM usage: %zu requests (%zu failed, %ld retries) in %.1f s\n"
+                  "Tokens: %ld prompt + %ld completion, estimated cost $%.4f\n"
+                  "Latency: p50 %.0f ms, p95 %.0f ms, p99 %.0f ms, max %.0f ms\n"
+                  "Answers: %zu valid, %zu repaired, %zu rejected, %zu missing, %zu malformed replies",
+                  summary.requests, summary.failed_requests, summary.retries, summary.elapsed_seconds,
+                  summary.prompt_tokens, summary.completion_tokens, summary.cost,
+                  summary.p50_ms, summary.p95_ms, summary.p99_ms, summary.max_ms,
+                  summary.answers_accepted, summary.answers_repaired, summary.answers_rejected,
+                  summary.answers_missing, summary.malformed_responses);
+    return text;
+}
+
+
+/**
+ * @brief Serializes the run summary, and optionally every request, as JSON.
+ */
+std::string LLMUsageTracker::to_json(const Summary &summary, bool with_requests) const
+{
+    std::time_t started_time = std::chrono::system_clock::to_time_t(started_wall);
+    char started_text[32];
+    std::strftime(started_text, sizeof(started_text), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&started_time));
+
+    Json::Value root;
+    root["started"] = started_text;
+    root["model"] = model;
+    root["elapsed_seconds"] = summary.elapsed_seconds;
+    root["requests"] = static_cast<Json::UInt64>(summary.requests);
+    root["failed_requests"] = static_cast<Json::UInt64>(summary.failed_requests);
+    root["retries"] = static_cast<Json::Int64>(summary.retries);
+    root["prompt_tokens"] = static_cast<Json::Int64>(summary.prompt_tokens);
+    root["completion_tokens"] = static_cast<Json::Int64>(summary.completion_tokens);
+    root["estimated_cost"] = summary.cost;
+
+    Json::Value latency;
+    latency["total_ms"] = summary.total_latency_ms;
+    latency["p50_ms"] = summary.p50_ms;
+    latency["p95_ms"] = summary.p95_ms;
+    latency["p99_ms"] = summary.p99_ms;
+    latency["max_ms"] = summary.max_ms;
+    root["latency"] = latency;
+
+    Json::Value parsing;
+    parsing["responses"] = static_cast<Json::UInt64>(summary.parsed_responses);
+    parsing["malformed_responses"] = static_cast<Json::UInt64>(summary.malformed_responses);
+    parsing["answers_accepted"] = static_cast<Json::UInt64>(summary.answers_accepted);
+    parsing["answers_repaired"] = static_cast<Json::UInt64>(summary.answers_repaired);
+    parsing["answers_rejected"] = static_cast<Json::UInt64>(summary.answers_rejected);
+    parsing["answers_missing"] = static_cast<Json::UInt64>(summary.answers_missing);
+    root["parsing"] = parsing;
+
+    if (with_requests) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        Json::Value histogram(Json::arrayValue);
+        for (size_t bucket = 0; bucket <= std::size(LATENCY_BUCKETS_MS); ++bucket) {
+            const double lower = bucket == 0 ? 0.0 : LATENCY_BUCKETS_MS[bucket - 1];
+            const bool is_last = bucket == std::size(LATENCY_BUCKETS_MS);
+            Json::UInt64 count = std::count_if(requests.begin(), requests.end(), [&](const RequestRecord &r) {
+                return (bucket == 0 || r.latency_ms > lower) &&
+                       (is_last || r.latency_ms <= LATENCY_BUCKETS_MS[bucket]);
+            });
+
+            Json::Value entry;
+            entry["le_ms"] = is_last ? Json::Value() : Json::Value(LATENCY_BUCKETS_MS[bucket]);
+            entry["count"] = count;
+            histogram.append(entry);
+        }
+        root["latency"]["histogram"] = histogram;
+
+        Json::Value items(Json::arrayValue);
+        for (const auto &request : requests) {
+            Json::Value item;
+            item["status"] = static_cast<Json::Int64>(request.status_code);
+            item["attempts"] = request.attempts;
+            item["prompt_tokens"] = static_cast<Json::Int64>(request.prompt_tokens);
+            item["completion_tokens"] = static_cast<Json::Int64>(request.completion_tokens);
+            item["latency_ms"] = request.latency_ms;
+            item["replayed"] = request.replayed;
+            items.append(item);
+        }
+        root["request_log"] = items;
+    }
+
+    Json::StreamWriterBuilder writer_builder;
+    writer_builder["indentation"] = with_requests ? "  " : "";
+    return Json::writeString(writer_builder, root);
+}
+
+
+/**
+ * @brief Writes the run summary, the latency histogram and every request to a JSON file.
+ *
+ * @param path The file to write, replaced if it exists.
+ * @return true if the file was written, false otherwise.
+ */
+bool LLMUsageTracker::dump_json(const std::string &path) const
+{
+    std::ofstream output(path, std::ios::trunc);
+    if (!output) {
+        g_printerr("Failed to write LLM usage report: %s\n", path.c_str());
+        return false;
+    }
+    output << to_json(summarize(), true) << '\n';
+    return static_cast<bool>(output);
+}
+
+
+/**
+ * @brief Appends a one-line summary of the run to a JSON Lines history file.
+ *
+ * Adding up the history gives the usage over any period, e.g. a billing month.
+ *
+ * @param path The history file, created if missing.
+ * @return true if the line was written, false otherwise.
+ */
+bool LLMUsageTracker::append_history(const std::string &path) const
+{
+    std::ofstream output(path, std::ios::app);
+    if (!output) {
+        g_printerr("Failed to append to LLM usage history: %s\n", path.c_str());
+        return false;
+    }
+    output << to_json(summarize(), false) << '\n';
+    return static_cast<bool>(output);
+}
@@ -1,20 +1,27 @@
 #include "MainApp.hpp"
 #include "CategorizationSession.hpp"
+#include "ContentSniffer.hpp"
 #include "CryptoManager.hpp"
 #include "ErrorMessages.hpp"
 #include "FileScanner.hpp"
+#include "Fingerprinter.hpp"
 #include "LLMClient.hpp"
 #include "Logger.hpp"
 #include "MainAppEditActions.hpp"
 #include "MainAppHelpActions.hpp"
+#include "ModelRouter.hpp"
+#include "RetryPolicy.hpp"
 #include "Updater.hpp"
 #include "Utils.hpp"
 #include "Types.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
-#include <future>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <gtk/gtk.h>
 #include <gtk/gtkfilechooser.h>
 #include <gtk/gtkwidget.h>
@@ -33,6 +40,19 @@
 
 extern GResource *resources_get_resource();
 
+// Size of the category vocabulary offered to the LLM in every batch request
+static constexpr size_t MAX_OFFERED_CATEGORIES = 40;
+static constexpr size_t MAX_OFFERED_SUBCATEGORIES = 160;
+
+// Background categorization of the entries queued while the LLM was unreachable
+static constexpr guint PENDING_DRAIN_INTERVAL_SECONDS = 60;
+static constexpr size_t PENDING_DRAIN_LIMIT = 500;
+static constexpr size_t PENDING_DRAIN_BATCH_SIZE = 100;
+
+// Pruning and compaction of the database, while no analysis is running
+static constexpr guint MAINTENANCE_CHECK_INTERVAL_SECONDS = 600;
+static constexpr std::chrono::hours MAINTENANCE_PERIOD{24};
+
 
 /**
  * Constructor for MainApp.
@@ -45,6 +65,7 @@ extern GResource *resources_get_resource();
  * - builder: a Gtk::Builder object for loading the UI from a file
  * - settings: a Settings object for storing and retrieving application settings
  * - db_manager: a DatabaseManager object for managing the database
+ * - rule_engine: a RuleEngine object that categorizes obvious files locally
  * - categorization_dialog: a CategorizationDialog object for displaying the
  *   categorization dialog
  * - use_subcategories_checkbox: a Gtk::CheckButton object for the "Use
@@ -68,6 +89,7 @@ MainApp::MainApp(int argc, char **argv)
     : builder(nullptr),
       settings(),
       db_manager(settings.get_config_dir()),
+      rule_engine(settings.get_config_dir()),
       categorization_dialog(nullptr),
       use_subcategories_checkbox(nullptr), 
       categorize_files_checkbox(nullptr), 
@@ -363,6 +385,8 @@ void MainApp::perform_analysis()
     }
 
     try {
+        // The categorization dialog queues its rows without waiting; see them here
+        db_manager.wait_for_writes();
         already_categorized_files = db_manager.get_categorized_files(directory_path);
 
         if (!already_categorized_files.empty()) {
@@ -470,15 +494,15 @@ void MainApp::perform_analysis()
 std::vector<FileEntry>
 MainApp::get_actual_files(const std::string& directory_path)
 {
-    core_logger->info("Getting actual files from directory %s", directory_path.c_str());
+    core_logger->info("Getting actual files from directory {}", directory_path);
 
     std::vector<FileEntry> actual_files =
         dirscanner.get_directory_entries(directory_path, FileScanOptions::Files | FileScanOptions::Directories);
     
-    core_logger->info("Actual files found: %d\n", static_cast<int>(actual_files.size()));
+    core_logger->info("Actual files found: {}", actual_files.size());
 
-    for (const auto& [full_file_path, file_name, file_type] : actual_files) {
-        core_logger->info("File: %s, Path: %s\n", file_name.c_str(), full_file_path.c_str());
+    for (const auto& entry : actual_files) {
+        core_logger->info("File: {}, Path: {}", entry.file_name, entry.full_path);
     }
 
     return actual_files;
@@ -495,11 +519,6 @@ void MainApp::on_analyze_button_clicked(GtkButton *button, gpointer main_app_ins
         return;
     }
 
-    if (!Utils::is_network_available()) {
-        app->show_error_dialog(ERR_NO_INTERNET_CONNECTION);
-        return;
-    }
-
     if (app->analyze_thread.joinable()) {
         app->stop_analysis = true;
         app->analyze_thread.join();
@@ -507,6 +526,8 @@ void MainApp::on_analyze_button_clicked(GtkButton *button, gpointer main_app_ins
         return;
     }
 
+    app->stop_pending_queue_drain();
+    app->stop_database_maintenance();
     app->stop_analysis = false;
     gtk_button_set_label(button, "Stop Analyzing");
 
@@ -525,7 +546,7 @@ void MainApp::on_analyze_button_clicked(GtkButton *button, gpointer main_app_ins
         try {
             app->perform_analysis();
         } catch (const std::exception &ex) {
-            app->core_logger->error("Exception during analysis: %s\n", ex.what());
+            app->core_logger->error("Exception during analysis: {}", ex.what());
         }
     });
 }
@@ -539,12 +560,18 @@ MainApp::find_files_to_categorize(const std::string& directory_path,
         dirscanner.get_directory_entries(directory_path, file_scan_options);
     std::vector<FileEntry> found_files;
 
-    for (const auto &[full_file_path, file_name, file_type] : actual_files) {
-        if (!cached_files.contains(file_name)) {
-            found_files.push_back({full_file_path, file_name, file_type});
+    for (auto &entry : actual_files) {
+        if (!cached_files.contains(entry.file_name)) {
+            found_files.push_back(std::move(entry));
         }
     }
 
+    // Fingerprint the new names, so renamed or moved files are recognized by their contents
+    const auto known_fingerprints = db_manager.get_fingerprints(found_files);
+    Fingerprinter::fingerprint_files(found_files, known_fingerprints, &stop_analysis);
+    // Best effort: a fingerprint that fails to store is recomputed next time
+    db_manager.store_fingerprints(found_files);
+
     return found_files;
 }
 
@@ -558,7 +585,9 @@ std::vector<CategorizedFile> MainApp::compute_files_to_sort()
                                               get_folder_path(), file_scan_options
                                               );
     
-    for (const auto &[full_file_path, file_name, file_type] : actual_files) {
+    for (const auto &entry : actual_files) {
+        const auto &file_name = entry.file_name;
+        const auto &file_type = entry.type;
         // Search for each file in already_categorized_files to get its category data
         auto it = std::find_if(
             already_categorized_files.begin(), 
@@ -590,68 +619,84 @@ std::string MainApp::get_folder_path()
 }
 
 
-std::tuple<std::string, std::string> split_category_subcategory(const std::string& input)
+static CategorizedFile to_categorized_file(const FileEntry& entry, const Categorization& categorization)
 {
-    std::string delimiter = " : ";
-    size_t colon_pos = input.find(delimiter);
-    if (colon_pos != std::string::npos) {
-        std::string category = input.substr(0, colon_pos);
-        std::string subcategory = input.substr(colon_pos + delimiter.length());
-        return std::make_tuple(category, subcategory);
-    } else {
-        return std::make_tuple(input, "");
-    }
+    return CategorizedFile{
+        std::filesystem::path(entry.full_path).parent_path().string(),
+        entry.file_name,
+        entry.type,
+        categorization.category,
+        categorization.subcategory
+    };
 }
 
 
+/**
+ * Categorizes the given entries, resolving as many as possible locally first.
+ *
+ * The stored categorizations of all entries are looked up in one go. Entries
+ * that are already known, matched by a local rule, identified by
+ * their contents or confidently predicted by the local name classifier are
+ * resolved without a network call. The remaining ones,
+ * with any content type detected on the way, are grouped into batches of
+ * Settings::get_batch_size() names and sent to the LLM by categorize_with_llm().
+ * The returned vector keeps the input order.
+ *
+ * @param items The files and directories to categorize.
+ *
+ * @return The categorized entries, in input order.
+ */
 std::vector<CategorizedFile> 
 MainApp::categorize_files(const std::vector<FileEntry>& items)
 {
-    CategorizationSession categorization_session;
-    LLMClient llm = categorization_session.create_llm_client();
+    std::vector<std::optional<CategorizedFile>> results(items.size());
+    std::vector<size_t> pending;
+
+    rule_engine.reload_if_changed();
+
+    const LLMBackend backend = settings.get_llm_backend();
+    llm_usage = std::make_shared<LLMUsageTracker>(backend.model,
+                                                  backend.prompt_price_per_million,
+                                                  backend.completion_price_per_million);
+    strong_llm_usage.reset();
+    if (settings.get_routing_enabled()) {
+        const LLMBackend strong_backend = settings.get_strong_llm_backend();
+        strong_llm_usage = std::make_shared<LLMUsageTracker>(strong_backend.model,
+                                                             strong_backend.prompt_price_per_million,
+                                                             strong_backend.completion_price_per_million);
+    }
 
-    std::vector<CategorizedFile> categorized_items;
+    std::vector<FileEntry> entries = items;
+    const std::vector<std::optional<Categorization>> stored = db_manager.lookup_many(entries);
 
-    for (const auto &[full_path, name, type] : items) {
-        if (stop_analysis) {
-            core_logger->info("Stopping categorization...\n");
-            return categorized_items;
+    for (size_t i = 0; i < entries.size() && !stop_analysis; ++i) {
+        if (auto categorization = resolve_locally(entries[i], stored[i])) {
+            results[i] = to_categorized_file(entries[i], *categorization);
+        } else if (auto detected = classify_by_content(entries[i])) {
+            results[i] = to_categorized_file(entries[i], *detected);
+        } else if (auto predicted = predict_by_name(entries[i])) {
+            results[i] = to_categorized_file(entries[i], *predicted);
+        } else {
+            pending.push_back(i);
         }
+    }
 
-        try {
-            const std::string& dir_path = std::filesystem::path(full_path).parent_path().string();
-            
-            auto report_progress = [this](const std::string& message) {
-                auto progress_data = std::make_unique<std::pair<MainApp*, std::string>>(this, message);
-
-                g_idle_add([](gpointer user_data) -> gboolean {
-                    auto progress_data = std::unique_ptr<std::pair<MainApp*, std::string>>(
-                        static_cast<std::pair<MainApp*, std::string>*>(user_data)
-                    );
-
-                    if (progress_data->first->progress_dialog) {
-                        progress_data->first->progress_dialog->append_text(progress_data->second + "\n");
-                    }
+    if (!pending.empty() && !stop_analysis) {
+        categorize_pending(entries, pending, results);
+    }
+
+    report_llm_usage();
+
+    if (stop_analysis) {
+        core_logger->info("Stopping categorization...\n");
+    }
 
-                    return G_SOURCE_REMOVE;
-                }, progress_data.release());
-            };
-
-            auto [category, subcategory] = categorize_file(llm, name, type, report_progress);
-
-            categorized_items.emplace_back(CategorizedFile{
-                                                dir_path,
-                                                name,
-                                                type,
-                                                category,
-                                                subcategory
-                                            });
-
-        } catch (const std::exception& ex) {
-            std::string error_message = "Error categorizing file \"" + name + "\": " + ex.what();
-            show_error_dialog(error_message);
-            core_logger->error("%s\n", error_message.c_str());
-            break;
+    std::vector<CategorizedFile> categorized_items;
+    categorized_items.reserve(items.size());
+
+    for (auto& result : results) {
+        if (result) {
+            categorized_items.push_back(std::move(*result));
         }
     }
 
@@ -659,86 +704,728 @@ MainApp::categorize_files(const std::vector<FileEntry>& items)
 }
 
 
-std::string MainApp::categorize_with_timeout(LLMClient& llm, const std::string& item_name,
-                                             const FileType file_type, int timeout_seconds)
+/**
+ * Categorizes the entries that could not be resolved locally, asking the LLM
+ * at most once per name.
+ *
+ * Every entry joins the single-flight table under its normalized name and type.
+ * Only the first entry for a key is sent to the LLM; duplicates within the run,
+ * and names already answered earlier in this session, attach to that request
+ * and reuse its answer. Failed requests are not kept, so they are retried by the
+ * next analysis.
+ *
+ * @param items All entries of the current run.
+ * @param pending The positions in items that still need a categorization.
+ * @param results The per-entry results to fill in.
+ */
+void MainApp::categorize_pending(const std::vector<FileEntry>& items,
+                                 const std::vector<size_t>& pending,
+                                 std::vector<std::optional<CategorizedFile>>& results)
 {
-    std::promise<std::string> promise;
-    std::future<std::string> future = promise.get_future();
+    std::vector<size_t> owned;
+    std::vector<std::pair<size_t, std::shared_future<SingleFlight::Result>>> attached;
 
-    std::thread([&llm, promise = std::move(promise), item_name, file_type]() mutable {
-        try {
-            std::string result = llm.categorize_file(item_name, file_type);
-            promise.set_value(result);
-        } catch (const std::exception& e) {
-            promise.set_exception(std::current_exception());
+    for (size_t index : pending) {
+        auto ticket = llm_requests.join(SingleFlight::make_key(items[index].file_name, items[index].type));
+        if (ticket.is_owner) {
+            owned.push_back(index);
+        } else {
+            attached.emplace_back(index, ticket.result);
         }
-    }).detach();
+    }
 
-    // Wait for result
-    if (future.wait_for(std::chrono::seconds(timeout_seconds)) == std::future_status::ready) {
-        return future.get();
-    } else {
-        throw std::runtime_error("Network timeout: LLM response took too long.");
+    auto complete_owned = [&]() {
+        for (size_t index : owned) {
+            SingleFlight::Result result;
+            if (results[index] && !results[index]->category.empty()) {
+                result = Categorization{results[index]->category, results[index]->subcategory};
+            }
+            llm_requests.complete(SingleFlight::make_key(items[index].file_name, items[index].type), result);
+        }
+    };
+
+    try {
+        if (!owned.empty() && !is_llm_reachable()) {
+            std::vector<FileEntry> deferred;
+            for (size_t index : owned) {
+                deferred.push_back(items[index]);
+            }
+            if (!db_manager.enqueue_pending_categorizations(deferred).get()) {
+                core_logger->warn("Failed to queue {} entries for a later attempt", deferred.size());
+            }
+            report_progress("The AI service cannot be reached. " + std::to_string(deferred.size()) +
+                            " entries were queued and will be categorized once it is back.");
+        } else if (!owned.empty()) {
+            ModelRouter router = create_model_router(&stop_analysis);
+            categorize_with_llm(router, items, owned, results);
+            if (router.has_strong_tier()) {
+                const std::string routing_summary = router.format_stats();
+                report_progress(routing_summary);
+                core_logger->info("{}", routing_summary);
+            }
+        }
+    } catch (...) {
+        complete_owned();
+        throw;
+    }
+    complete_owned();
+
+    for (auto& [index, future] : attached) {
+        if (auto categorization = future.get()) {
+            report_progress("Reused AI answer for: " + items[index].file_name +
+                            " [" + categorization->category + "/" + categorization->subcategory + "]");
+            results[index] = to_categorized_file(items[index], *categorization);
+        }
     }
 }
 
 
-std::tuple<std::string, std::string>
-MainApp::categorize_file(LLMClient& llm, const std::string& item_name,
-                         const FileType file_type,
-                         const std::function<void(const std::string&)>& report_progress)
+/**
+ * Sends the pending entries to the LLM in batches, using a bounded pool of workers.
+ *
+ * Up to Settings::get_max_concurrent_requests() batch requests are kept in flight.
+ * Every worker claims the next unprocessed batch and writes its answers into the
+ * slots of results that belong to the batch, so the input order is preserved.
+ * Every batch goes through the router, which escalates the hard entries to the
+ * strong tier when one is configured. Transient failures are retried inside
+ * LLMClient. A batch that still fails is reported, left out of the results and
+ * queued for the background drain, while the other batches carry on. Only errors that would fail every
+ * request, such as an invalid API key, stop the workers. Raising stop_analysis
+ * also aborts the requests in flight, so all workers are joined before this
+ * function returns.
+ *
+ * @param router The router used to send the requests.
+ * @param items All entries of the current run.
+ * @param pending The positions in items that still need a categorization.
+ * @param results The per-entry results to fill in.
+ */
+void MainApp::categorize_with_llm(ModelRouter& router,
+                                  const std::vector<FileEntry>& items,
+                                  const std::vector<size_t>& pending,
+                                  std::vector<std::optional<CategorizedFile>>& results)
 {
-    // Check the local database with the item name and type
-    auto categorization = db_manager.get_categorization_from_db(item_name, file_type);
-    if (categorization.size() >= 2) {
-        std::string category = categorization[0];
-        std::string subcategory = categorization[1];
-        core_logger->info("Found in local DB: %s - Category: %s, Subcategory: %s\n", item_name.c_str(), category.c_str(), subcategory.c_str());
-        std::string message = 
-            "\nFound in local DB: " + item_name + " [" + category + "/" + subcategory + "]";
-        report_progress(message);
-        return std::make_tuple(category, subcategory);
+    const size_t batch_size = settings.get_batch_size();
+    const size_t batch_count = (pending.size() + batch_size - 1) / batch_size;
+
+    std::atomic<size_t> next_batch{0};
+    std::atomic<bool> failed{false};
+    std::mutex error_mutex;
+    std::string error_message;
+
+    auto worker = [&]() {
+        while (!stop_analysis && !failed) {
+            const size_t batch = next_batch.fetch_add(1);
+            if (batch >= batch_count) {
+                return;
+            }
+
+            const size_t first = batch * batch_size;
+            const size_t last = std::min(first + batch_size, pending.size());
+
+            std::vector<FileEntry> batch_entries;
+            batch_entries.reserve(last - first);
+            for (size_t i = first; i < last; ++i) {
+                batch_entries.push_back(items[pending[i]]);
+            }
+
+            try {
+                auto categorizations = router.categorize_files(batch_entries);
+
+                for (size_t i = 0; i < batch_entries.size(); ++i) {
+                    const FileEntry& entry = batch_entries[i];
+                    Categorization categorization = db_manager.get_vocabulary().canonicalize(
+                        categorizations[i].value_or(Categorization{}));
+
+                    if (categorizations[i]) {
+                        report_progress("Suggested by AI: " + entry.file_name +
+                                        " [" + categorization.category + "/" + categorization.subcategory + "]");
+                    } else {
+                        report_progress("No valid answer from AI for: " + entry.file_name);
+                    }
+
+                    results[pending[first + i]] = to_categorized_file(entry, categorization);
+                }
+            } catch (const LLMRequestError& ex) {
+                if (!ex.is_fatal()) {
+                    defer_failed_batch(batch_entries, ex.what());
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!failed.exchange(true)) {
+                    error_message = "Error categorizing \"" + batch_entries.front().file_name +
+                                    "\": " + ex.what();
+                }
+            } catch (const std::exception& ex) {
+                if (stop_analysis) {
+                    return;
+                }
+                defer_failed_batch(batch_entries, ex.what());
+            }
+        }
+    };
+
+    const size_t worker_count = std::min<size_t>(settings.get_max_concurrent_requests(), batch_count);
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back(worker);
     }
 
-    const char* env_pc = std::getenv("ENV_PC");
-    const char* env_rr = std::getenv("ENV_RR");
+    for (auto& worker_thread : workers) {
+        worker_thread.join();
+    }
+
+    if (failed) {
+        report_progress("LLM Error: " + error_message);
+        show_error_dialog(error_message);
+        core_logger->error("{}", error_message);
+    }
+}
+
+
+/**
+ * Reports a batch that could not be categorized and queues it for later.
+ *
+ * The entries are left out of the results of the current run and stored in
+ * the pending queue, which is drained in the background once the LLM can be
+ * reached again.
+ *
+ * @param batch_entries The entries of the failed batch.
+ * @param reason The error that made the batch fail.
+ */
+void MainApp::defer_failed_batch(const std::vector<FileEntry>& batch_entries, const std::string& reason)
+{
+    std::string message = "LLM Error for " + std::to_string(batch_entries.size()) +
+                           " entries, starting with \"" + batch_entries.front().file_name + "\": " + reason +
+                           ". They were queued for a later attempt.";
+    report_progress(message);
+    core_logger->warn("{}", message);
+    if (!db_manager.enqueue_pending_categorizations(batch_entries).get()) {
+        core_logger->warn("Failed to queue {} entries for a later attempt", batch_entries.size());
+    }
+}
+
+
+/**
+ * Tells whether LLM requests can be sent right now.
+ *
+ * Replayed cassettes and local backends need no internet connection. Otherwise
+ * the circuit breaker must be closed and the network available.
+ *
+ * @return true if requests can be sent, false if entries should be queued instead.
+ */
+bool MainApp::is_llm_reachable()
+{
+    if (LLMCassette::parse_mode(settings.get_cassette_mode()) == LLMCassette::Mode::Replay) {
+        return true;
+    }
+    if (circuit_breaker->is_open()) {
+        return false;
+    }
+    return settings.get_llm_backend().is_local() || Utils::is_network_available();
+}
+
+
+/**
+ * Starts the timer that drains the pending queue in the background.
+ */
+void MainApp::start_pending_queue_drain()
+{
+    drain_timer_id = g_timeout_add_seconds(PENDING_DRAIN_INTERVAL_SECONDS, on_drain_timer, this);
+}
+
+
+/**
+ * Cancels a running drain of the pending queue and waits for it to end.
+ *
+ * Called before an analysis starts, so that only one thread uses the LLM
+ * client and the database at a time.
+ */
+void MainApp::stop_pending_queue_drain()
+{
+    if (drain_thread.joinable()) {
+        stop_drain = true;
+        drain_thread.join();
+    }
+    stop_drain = false;
+}
+
+
+/**
+ * Periodically starts a drain of the pending queue, unless an analysis or a
+ * previous drain is still running.
+ */
+gboolean MainApp::on_drain_timer(gpointer user_data)
+{
+    MainApp* app = static_cast<MainApp*>(user_data);
+
+    if (app->analyze_thread.joinable() || app->drain_running) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    if (app->drain_thread.joinable()) {
+        app->drain_thread.join();
+    }
+
+    app->drain_running = true;
+    app->drain_thread = std::thread([app]() {
+        app->drain_pending_queue();
+        app->drain_running = false;
+    });
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+/**
+ * Categorizes queued entries in large batches and stores the answers in the database.
+ *
+ * Nothing is sent while the circuit breaker is open or the network is down.
+ * Answered entries are removed from the queue. The answers are stored
+ * unconfirmed; the next analysis of their folder shows them for review, and
+ * only then are they learned from. A batch whose request fails counts as an
+ * attempt for each of its entries, and the drain moves on to the next batch.
+ * It stops when the endpoint refuses the credentials or becomes unavailable,
+ * leaving the rest of the queue for the next round.
+ */
+void MainApp::drain_pending_queue()
+{
+    std::vector<FileEntry> entries = db_manager.get_pending_categorizations(PENDING_DRAIN_LIMIT);
+    if (entries.empty() || stop_drain || !is_llm_reachable()) {
+        return;
+    }
+
+    core_logger->info("Categorizing {} queued entries", entries.size());
 
-    std::string key;
     try {
-        CryptoManager crypto(env_pc, env_rr);
-        key = crypto.reconstruct();
+        ModelRouter router = create_model_router(&stop_drain);
+
+        for (size_t first = 0; first < entries.size() && !stop_drain; first += PENDING_DRAIN_BATCH_SIZE) {
+            const size_t last = std::min(first + PENDING_DRAIN_BATCH_SIZE, entries.size());
+            std::span<const FileEntry> batch(entries.data() + first, last - first);
+
+            std::vector<std::optional<Categorization>> categorizations;
+            try {
+                categorizations = router.categorize_files(batch);
+            } catch (const LLMRequestError& ex) {
+                if (ex.is_fatal()) {
+                    core_logger->warn("Draining the pending queue stopped: {}", ex.what());
+                    return;
+                }
+                core_logger->warn("Failed to categorize {} queued entries: {}", batch.size(), ex.what());
+                record_drain_attempts({batch.begin(), batch.end()});
+                continue;
+            } catch (const LLMUnavailableError& ex) {
+                core_logger->warn("Draining the pending queue stopped: {}", ex.what());
+                return;
+            } catch (const std::exception& ex) {
+                if (stop_drain) {
+                    return;
+                }
+                core_logger->warn("Failed to categorize {} queued entries: {}", batch.size(), ex.what());
+                record_drain_attempts({batch.begin(), batch.end()});
+                continue;
+            }
+
+            std::vector<FileEntry> unanswered;
+            std::vector<FileEntry> answered;
+            std::vector<CategorizedFile> categorized;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (!categorizations[i]) {
+                    unanswered.push_back(batch[i]);
+                    continue;
+                }
+
+                Categorization categorization = db_manager.get_vocabulary().canonicalize(*categorizations[i]);
+                categorized.push_back(to_categorized_file(batch[i], categorization));
+                answered.push_back(batch[i]);
+            }
+            // Entries stay queued unless their answers were stored
+            if (!db_manager.insert_or_update_files_with_categorization(categorized, false).get()) {
+                core_logger->warn("Failed to store the answers for {} queued entries", categorized.size());
+            } else if (!db_manager.remove_pending_categorizations(answered).get()) {
+                core_logger->warn("Failed to remove {} answered entries from the queue", answered.size());
+            }
+            record_drain_attempts(unanswered);
+        }
     } catch (const std::exception& ex) {
-        std::string message = "CryptoManager error for \"" + item_name + "\": " + ex.what();
-        report_progress(message);
-        g_printerr("%s\n", message.c_str());
-        return std::make_tuple("", "");
+        core_logger->warn("Draining the pending queue stopped: {}", ex.what());
+    }
+}
+
+
+/**
+ * Counts a failed attempt for queued entries, so that entries which keep
+ * failing are eventually given up instead of blocking the queue.
+ */
+void MainApp::record_drain_attempts(const std::vector<FileEntry>& entries)
+{
+    if (!db_manager.record_pending_attempts(entries).get()) {
+        core_logger->warn("Failed to record the attempts of {} queued entries", entries.size());
+    }
+}
+
+
+/**
+ * Starts the timer that runs the database maintenance in the background.
+ */
+void MainApp::start_database_maintenance()
+{
+    maintenance_timer_id = g_timeout_add_seconds(MAINTENANCE_CHECK_INTERVAL_SECONDS, on_maintenance_timer, this);
+}
+
+
+/**
+ * Asks a running database maintenance to stop, without waiting for it.
+ *
+ * Called before an analysis starts, so maintenance never competes with it for
+ * the disk and the database. Every maintenance step checks the flag, so the
+ * thread ends shortly after; it is joined by the next maintenance check or at
+ * shutdown. An interrupted maintenance is resumed at the next idle check
+ * instead of a day later.
+ */
+void MainApp::stop_database_maintenance()
+{
+    if (maintenance_running) {
+        next_maintenance = {};
+        stop_maintenance = true;
+    }
+}
+
+
+/**
+ * Periodically starts the database maintenance, once every MAINTENANCE_PERIOD,
+ * unless an analysis, a drain of the pending queue or a previous maintenance
+ * is still running.
+ */
+gboolean MainApp::on_maintenance_timer(gpointer user_data)
+{
+    MainApp* app = static_cast<MainApp*>(user_data);
+
+    if (app->analyze_thread.joinable() || app->drain_running || app->maintenance_running ||
+        std::chrono::steady_clock::now() < app->next_maintenance) {
+        return G_SOURCE_CONTINUE;
     }
 
+    if (app->maintenance_thread.joinable()) {
+        app->maintenance_thread.join();
+    }
+
+    app->stop_maintenance = false;
+    app->next_maintenance = std::chrono::steady_clock::now() + MAINTENANCE_PERIOD;
+    app->maintenance_running = true;
+    app->maintenance_thread = std::thread([app]() {
+        app->run_database_maintenance();
+        app->maintenance_running = false;
+    });
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+/**
+ * Prunes the categorizations of files that are gone and compacts the database.
+ *
+ * See DatabaseManager::run_maintenance. The outcome is logged, including how
+ * much space was returned to the file system.
+ */
+void MainApp::run_database_maintenance()
+{
     try {
-        std::string category_subcategory;
-        try {
-            category_subcategory = categorize_with_timeout(llm, item_name, file_type, 10);
-        } catch (const std::exception& ex) {
-            std::string message = "LLM Timeout/Error: " + std::string(ex.what());
-            report_progress(message);
-            g_printerr("%s\n", message.c_str());
-            return std::make_tuple("", "");
+        const DatabaseManager::MaintenanceReport report = db_manager.run_maintenance(stop_maintenance);
+        if (report.completed) {
+            core_logger->info("Database maintenance: checked {} rows, pruned {}, reclaimed {} bytes",
+                              report.rows_checked, report.rows_pruned, report.bytes_reclaimed);
+        } else {
+            core_logger->info("Database maintenance stopped after checking {} rows, pruned {}",
+                              report.rows_checked, report.rows_pruned);
         }
+    } catch (const std::exception& ex) {
+        core_logger->warn("Database maintenance failed: {}", ex.what());
+    }
+}
 
-        auto [category, subcategory] = split_category_subcategory(category_subcategory);
 
-        std::ostringstream message;
-        message << "Suggested by AI: " << item_name << " [" << category << "/" << subcategory << "]";
-        report_progress(message.str());
+/**
+ * Reports the LLM traffic of the current run.
+ *
+ * The summary is shown in the progress dialog. The full report, with every
+ * request and a latency histogram, is written to llm_usage_last_run.json in the
+ * configuration directory, and a summary line is appended to
+ * llm_usage_history.jsonl there, to follow the spending across runs. With
+ * model routing enabled, the strong tier is reported separately, to
+ * llm_usage_strong_last_run.json.
+ */
+void MainApp::report_llm_usage()
+{
+    const std::filesystem::path config_dir = settings.get_config_dir();
 
-        return std::make_tuple(category, subcategory);
-    } catch (const std::exception& ex) {
-        std::ostringstream message;
-        message << "LLM Error \"" << ex.what();
-        report_progress(message.str());
-        g_printerr("%s\n", message.str().c_str());
-        throw;
+    auto report = [&](const std::shared_ptr<LLMUsageTracker>& usage, const std::string& report_name) {
+        if (!usage || usage->summarize().requests == 0) {
+            return;
+        }
+
+        const std::string summary = usage->format_summary();
+        report_progress("\n" + summary);
+        core_logger->info("{}", summary);
+
+        usage->dump_json((config_dir / report_name).string());
+        usage->append_history((config_dir / "llm_usage_history.jsonl").string());
+    };
+
+    report(llm_usage, "llm_usage_last_run.json");
+    report(strong_llm_usage, "llm_usage_strong_last_run.json");
+}
+
+
+/**
+ * Creates the router used for the LLM requests of one analysis or queue drain.
+ *
+ * The [LLM] backend answers first. When routing is enabled, entries it is
+ * unsure about are escalated to the [LLM.Strong] backend. Each tier reports to
+ * its own usage tracker and has its own circuit breaker, so an outage of the
+ * strong tier never stops the fast one.
+ *
+ * @param cancel_flag The flag that cancels the requests of both tiers.
+ *
+ * @return The configured router.
+ */
+ModelRouter MainApp::create_model_router(const std::atomic<bool>* cancel_flag)
+{
+    LLMClient fast_tier = create_llm_client(settings.get_llm_backend(), cancel_flag);
+    fast_tier.set_usage_tracker(llm_usage);
+    fast_tier.set_circuit_breaker(circuit_breaker);
+
+    if (!settings.get_routing_enabled()) {
+        return ModelRouter(std::move(fast_tier));
     }
+
+    LLMClient strong_tier = create_llm_client(settings.get_strong_llm_backend(), cancel_flag);
+    strong_tier.set_usage_tracker(strong_llm_usage);
+    strong_tier.set_circuit_breaker(strong_circuit_breaker);
+
+    ModelRouter::Policy policy;
+    policy.escalation_threshold = settings.get_escalation_threshold();
+    policy.escalate_conflicts = settings.get_escalate_conflicts();
+
+    return ModelRouter(std::move(fast_tier), std::move(strong_tier), policy);
+}
+
+
+/**
+ * Creates a client for one of the configured LLM backends.
+ *
+ * The client shares the rate limiter and the cassette with earlier runs. The
+ * most used categories of the vocabulary are offered to the model, or the
+ * vocabulary pinned in the cassette when one is recorded or replayed. When
+ * replaying a cassette no key is needed, so the key decryption is skipped.
+ *
+ * @param backend The backend to send the requests to.
+ * @param cancel_flag The flag that cancels the requests, e.g. stop_analysis.
+ *
+ * @return The configured client.
+ */
+LLMClient MainApp::create_llm_client(const LLMBackend& backend, const std::atomic<bool>* cancel_flag)
+{
+    std::shared_ptr<LLMCassette> llm_cassette = get_cassette();
+
+    LLMClient llm = (llm_cassette && llm_cassette->get_mode() == LLMCassette::Mode::Replay)
+        ? LLMClient(backend, "")
+        : CategorizationSession(backend).create_llm_client();
+
+    llm.set_cancel_flag(cancel_flag);
+    llm.set_retry_policy(RetryPolicy(settings.get_max_retries()));
+    llm.set_rate_limiter(get_rate_limiter());
+    llm.set_cassette(llm_cassette);
+
+    std::vector<CategoryVocabulary::Entry> vocabulary =
+        db_manager.get_vocabulary().get_most_used(MAX_OFFERED_CATEGORIES, MAX_OFFERED_SUBCATEGORIES);
+    if (llm_cassette) {
+        vocabulary = llm_cassette->pin_vocabulary(vocabulary);
+    }
+    llm.set_vocabulary(vocabulary);
+    return llm;
+}
+
+
+/**
+ * Returns the rate limiter shared by all categorization requests.
+ *
+ * The limiter is created on first use from the configured request and token
+ * rates, and kept across analyses so that consecutive runs respect the same
+ * per-minute budget.
+ *
+ * @return The shared rate limiter.
+ */
+std::shared_ptr<RateLimiter> MainApp::get_rate_limiter()
+{
+    if (!rate_limiter) {
+        rate_limiter = std::make_shared<RateLimiter>(settings.get_requests_per_minute(),
+                                                     settings.get_tokens_per_minute());
+    }
+    return rate_limiter;
+}
+
+
+/**
+ * Retrieves the cassette configured in the [Cassette] section, if any.
+ *
+ * The cassette is opened on first use and kept for the lifetime of the app,
+ * so a recording grows across analyses.
+ *
+ * @return The cassette, or nullptr when recording and replaying are off.
+ */
+std::shared_ptr<LLMCassette> MainApp::get_cassette()
+{
+    LLMCassette::Mode mode = LLMCassette::parse_mode(settings.get_cassette_mode());
+    if (mode == LLMCassette::Mode::Off) {
+        return nullptr;
+    }
+
+    if (!cassette) {
+        cassette = std::make_shared<LLMCassette>(
+            settings.get_cassette_path(), mode,
+            std::chrono::milliseconds(settings.get_cassette_latency_ms()));
+        core_logger->info("LLM cassette {} in {} mode with {} responses",
+                          settings.get_cassette_path(), settings.get_cassette_mode(), cassette->size());
+    }
+    return cassette;
+}
+
+
+/**
+ * Tries to categorize an entry without contacting the LLM.
+ *
+ * The categorization stored for the exact name comes first, then the local
+ * database is consulted by name template, so names differing only in dates,
+ * versions, hashes or counters reuse an earlier categorization. The
+ * user-editable rules of the RuleEngine come last.
+ *
+ * @param entry The file or directory to categorize.
+ * @param stored The categorization stored for the name, as found by DatabaseManager::lookup_many().
+ *
+ * @return The stored categorization, or an empty optional if the entry is unknown.
+ */
+std::optional<Categorization> MainApp::resolve_locally(const FileEntry& entry,
+                                                      const std::optional<Categorization>& stored)
+{
+    if (stored) {
+        const std::string& category = stored->category;
+        const std::string& subcategory = stored->subcategory;
+        core_logger->info("Found in local DB: {} - Category: {}, Subcategory: {}", entry.file_name, category, subcategory);
+        report_progress("\nFound in local DB: " + entry.file_name + " [" + category + "/" + subcategory + "]");
+        return stored;
+    }
+
+    auto categorization = db_manager.get_categorization_from_template(entry.file_name, entry.type);
+    if (categorization.size() >= 2) {
+        report_progress("Matched a known name pattern: " + entry.file_name +
+                        " [" + categorization[0] + "/" + categorization[1] + "]");
+        return Categorization{categorization[0], categorization[1]};
+    }
+
+    if (auto rule_match = rule_engine.match(entry)) {
+        report_progress("Resolved locally: " + entry.file_name +
+                        " [" + rule_match->category + "/" + rule_match->subcategory + "]");
+        return rule_match;
+    }
+
+    return std::nullopt;
+}
+
+
+/**
+ * Identifies a file by the magic numbers at the start of its contents.
+ *
+ * Only the first few KB of the file are read. Files whose names say little
+ * about them, such as "scan0001" or "download", are categorized locally when
+ * their type is identified confidently. Otherwise the detected type is stored
+ * in the entry, so that it is sent to the LLM along with the name.
+ *
+ * @param entry The file to inspect. Its content_type is set when a type is detected.
+ *
+ * @return The categorization for a confidently identified file, or an empty optional.
+ */
+std::optional<Categorization> MainApp::classify_by_content(FileEntry& entry)
+{
+    if (entry.type != FileType::File) {
+        return std::nullopt;
+    }
+
+    auto detected = ContentSniffer::sniff(entry.full_path);
+    if (!detected) {
+        return std::nullopt;
+    }
+
+    if (detected->is_confident && !ContentSniffer::has_informative_extension(entry.file_name)) {
+        report_progress("Identified by contents: " + entry.file_name + " (" + detected->description + ") [" +
+                        detected->categorization.category + "/" + detected->categorization.subcategory + "]");
+        return detected->categorization;
+    }
+
+    entry.content_type = detected->description;
+    return std::nullopt;
+}
+
+
+/**
+ * Asks the local name classifier, trained from the database, for a categorization.
+ *
+ * The prediction is used only once the classifier has learned enough stored
+ * categorizations and is at least as confident as configured in [Classifier];
+ * otherwise the entry goes on to the LLM.
+ *
+ * @param entry The file or directory to categorize.
+ *
+ * @return The predicted categorization, or an empty optional if it is not confident enough.
+ */
+std::optional<Categorization> MainApp::predict_by_name(const FileEntry& entry)
+{
+    if (!settings.get_classifier_enabled()) {
+        return std::nullopt;
+    }
+
+    const NameClassifier& classifier = db_manager.get_classifier();
+    if (classifier.sample_count() < static_cast<size_t>(settings.get_classifier_min_samples())) {
+        return std::nullopt;
+    }
+
+    auto prediction = classifier.predict(entry.file_name, entry.type);
+    if (!prediction || prediction->confidence < settings.get_classifier_min_confidence()) {
+        return std::nullopt;
+    }
+
+    report_progress("Predicted locally: " + entry.file_name + " [" + prediction->category + "/" +
+                    prediction->subcategory + "] (" +
+                    std::to_string(static_cast<int>(prediction->confidence * 100)) + "%)");
+    return prediction;
+}
+
+
+/**
+ * Appends a line to the progress dialog from any thread.
+ *
+ * The text is handed over to the GTK main loop, which owns the dialog.
+ *
+ * @param message The line to append.
+ */
+void MainApp::report_progress(const std::string& message)
+{
+    auto progress_data = std::make_unique<std::pair<MainApp*, std::string>>(this, message);
+
+    g_idle_add([](gpointer user_data) -> gboolean {
+        auto progress_data = std::unique_ptr<std::pair<MainApp*, std::string>>(
+            static_cast<std::pair<MainApp*, std::string>*>(user_data)
+        );
+
+        if (progress_data->first->progress_dialog) {
+            progress_data->first->progress_dialog->append_text(progress_data->second + "\n");
+        }
+
+        return G_SOURCE_REMOVE;
+    }, progress_data.release());
 }
 
 
@@ -750,7 +1437,7 @@ void MainApp::show_results_dialog(const std::vector<CategorizedFile>& results)
         categorization_dialog = new CategorizationDialog(&db_manager, show_subcategory_col);
         this->categorization_dialog->show_results(results);
     } catch (const std::runtime_error &ex) {
-        ui_logger->error("Error: %s\n", ex.what());;
+        ui_logger->error("Error: {}", ex.what());
     }
 }
 
@@ -861,8 +1548,10 @@ void MainApp::on_activate()
         setup_main_window();
         initialize_ui_components();
         start_updater();
+        start_pending_queue_drain();
+        start_database_maintenance();
     } catch (const std::exception &e) {
-        ui_logger->critical("Exception in MainApp::on_activate: %s", e.what());
+        ui_logger->critical("Exception in MainApp::on_activate: {}", e.what());
     }
 }
 
@@ -875,7 +1564,7 @@ void MainApp::initialize_builder() {
     }
     GError *error = NULL;
     if (!gtk_builder_add_from_resource(builder, "/net/quicknode/AIFileSorter/ui/main_window.glade", &error)) {
-        ui_logger->critical("Failed to load resource: %s", error->message);
+        ui_logger->critical("Failed to load resource: {}", error->message);
         g_error_free(error);
         g_object_unref(builder);
         throw std::runtime_error("Resource loading failed.");
@@ -918,7 +1607,7 @@ void MainApp::set_app_icon()
     GdkPixbuf *pixbuf_icon = gdk_pixbuf_new_from_resource("/net/quicknode/AIFileSorter/images/app_icon_128.png", &error);
     
     if (!pixbuf_icon) {
-        ui_logger->critical("Failed to load the app icon resource: %s", error->message);
+        ui_logger->critical("Failed to load the app icon resource: {}", error->message);
         g_clear_error(&error);
     } else {
         gtk_window_set_icon(GTK_WINDOW(main_window), pixbuf_icon);
@@ -926,7 +1615,7 @@ void MainApp::set_app_icon()
         // Debugging: Check the reference count before unref
         g_object_ref(pixbuf_icon);  // Increase ref count to check
         gsize ref_count = G_OBJECT(pixbuf_icon)->ref_count;
-        ui_logger->debug("Pixbuf ref count before unref: %zu", ref_count);
+        ui_logger->debug("Pixbuf ref count before unref: {}", ref_count);
 
         g_object_unref(pixbuf_icon);
     }
@@ -1068,6 +1757,21 @@ void MainApp::shutdown() {
         analyze_thread.join();
     }
 
+    if (drain_timer_id != 0) {
+        g_source_remove(drain_timer_id);
+        drain_timer_id = 0;
+    }
+    stop_pending_queue_drain();
+
+    if (maintenance_timer_id != 0) {
+        g_source_remove(maintenance_timer_id);
+        maintenance_timer_id = 0;
+    }
+    stop_maintenance = true;
+    if (maintenance_thread.joinable()) {
+        maintenance_thread.join();
+    }
+
     g_signal_handlers_disconnect_by_data(categorize_files_checkbox, this);
     g_signal_handlers_disconnect_by_data(categorize_directories_checkbox, this);
 
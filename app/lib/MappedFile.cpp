@@ -0,0 +1,144 @@
+#include "MappedFile.hpp"
+#include <algorithm>
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+/**
+ * @brief Maps the beginning of a regular file read-only into memory.
+ *
+ * Only the requested prefix is mapped, and the kernel is told it will be read
+ * once, sequentially, so that scanning many files only pages in their headers.
+ * Anything that is not a non-empty regular file, or cannot be opened, leaves
+ * the object closed.
+ *
+ * @param path The file to map.
+ * @param max_bytes The number of bytes to map at most, or 0 for the whole file.
+ */
+MappedFile::MappedFile(const std::string &path, size_t max_bytes)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0) {
+        CloseHandle(file);
+        return;
+    }
+
+    length = static_cast<size_t>(file_size.QuadPart);
+    if (max_bytes > 0) {
+        length = std::min(length, max_bytes);
+    }
+
+    mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping_handle) {
+        length = 0;
+        return;
+    }
+
+    mapped = static_cast<const unsigned char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, length));
+    if (!mapped) {
+        CloseHandle(mapping_handle);
+        mapping_handle = nullptr;
+        length = 0;
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size <= 0) {
+        close(fd);
+        return;
+    }
+
+    length = static_cast<size_t>(file_stat.st_size);
+    if (max_bytes > 0) {
+        length = std::min(length, max_bytes);
+    }
+
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, static_cast<off_t>(length), POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+#endif
+
+    void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (address == MAP_FAILED) {
+        length = 0;
+        return;
+    }
+    mapped = static_cast<const unsigned char*>(address);
+#endif
+}
+
+
+/**
+ * @brief Unmaps the file.
+ */
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (mapped) {
+        UnmapViewOfFile(mapped);
+    }
+    if (mapping_handle) {
+        CloseHandle(mapping_handle);
+    }
+#else
+    if (mapped) {
+        munmap(const_cast<unsigned char*>(mapped), length);
+    }
+#endif
+}
+
+
+/**
+ * @brief Tells whether the file was mapped.
+ */
+bool MappedFile::is_open() const
+{
+    return mapped != nullptr;
+}
+
+
+/**
+ * @brief Retrieves the mapped bytes, or nullptr if the file is not mapped.
+ */
+const unsigned char* MappedFile::data() const
+{
+    return mapped;
+}
+
+
+/**
+ * @brief Retrieves the number of mapped bytes.
+ */
+size_t MappedFile::size() const
+{
+    return length;
+}
+
+
+/**
+ * @brief Retrieves the mapped bytes as a string view.
+ */
+std::string_view MappedFile::view() const
+{
+    return mapped ? std::string_view(reinterpret_cast<const char*>(mapped), length) : std::string_view();
+}
@@ -0,0 +1,215 @@
+#include "ModelRouter.hpp"
+#include "CategoryVocabulary.hpp"
+#include "NameTemplate.hpp"
+#include <glib.h>
+#include <sstream>
+#include <unordered_map>
+
+
+/**
+ * @brief Constructs a router that sends every request to a single model.
+ *
+ * @param fast_tier The client of the only model.
+ */
+ModelRouter::ModelRouter(LLMClient fast_tier)
+    : fast_tier(std::move(fast_tier))
+{}
+
+
+/**
+ * @brief Constructs a router that escalates hard entries to a stronger model.
+ *
+ * @param fast_tier The client of the cheap model, which answers first.
+ * @param strong_tier The client of the stronger model, which gets the escalated entries.
+ * @param policy When an answer of the fast tier is escalated.
+ */
+ModelRouter::ModelRouter(LLMClient fast_tier, LLMClient strong_tier, const Policy& policy)
+    : fast_tier(std::move(fast_tier)),
+      strong_tier(std::move(strong_tier)),
+      policy(policy)
+{}
+
+
+/**
+ * @brief Categorizes a batch with the fast tier, escalating the hard entries.
+ *
+ * An entry is escalated to the strong tier when the fast tier gave no answer,
+ * an answer below the policy's confidence threshold, or an answer that
+ * disagrees with the one of another entry of the batch sharing its name
+ * template. Answers of the strong tier replace those of the fast tier. If the
+ * strong tier fails or has no answer, the answer of the fast tier is kept.
+ *
+ * @param entries The files or directories to be categorized.
+ *
+ * @return One element per input entry, in input order. An element is empty if
+ *         neither tier gave a valid categorization for it.
+ *
+ * @exception std::runtime_error If a request of the fast tier fails, or the
+ *            strong tier rejects the credentials.
+ */
+std::vector<std::optional<Categorization>>
+ModelRouter::categorize_files(std::span<const FileEntry> entries)
+{
+    std::vector<std::optional<Categorization>> answers = fast_tier.categorize_files(entries);
+
+    Stats batch_stats;
+    batch_stats.requested = entries.size();
+
+    std::vector<size_t> escalated;
+    if (strong_tier) {
+        const std::vector<bool> conflicts = policy.escalate_conflicts
+            ? find_conflicts(entries, answers)
+            : std::vector<bool>(entries.size(), false);
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (!answers[i]) {
+                ++batch_stats.escalated_unanswered;
+            } else if (answers[i]->confidence < policy.escalation_threshold) {
+                ++batch_stats.escalated_low_confidence;
+            } else if (conflicts[i]) {
+                ++batch_stats.escalated_conflicting;
+            } else {
+                continue;
+            }
+            escalated.push_back(i);
+        }
+    }
+
+    batch_stats.answered_by_fast_tier = entries.size() - escalated.size();
+
+    if (!escalated.empty()) {
+        std::vector<FileEntry> hard_entries;
+        hard_entries.reserve(escalated.size());
+        for (size_t index : escalated) {
+            hard_entries.push_back(entries[index]);
+        }
+
+        try {
+            auto strong_answers = strong_tier->categorize_files(hard_entries);
+            for (size_t i = 0; i < escalated.size(); ++i) {
+                if (strong_answers[i]) {
+                    answers[escalated[i]] = std::move(strong_answers[i]);
+                    ++batch_stats.answered_by_strong_tier;
+                }
+            }
+        } catch (const LLMRequestError& ex) {
+            if (ex.is_fatal()) {
+                throw;
+            }
+            g_printerr("Escalation failed, keeping the answers of the fast tier: %s\n", ex.what());
+            batch_stats.failed_escalations += escalated.size();
+        } catch (const std::exception& ex) {
+            g_printerr("Escalation failed, keeping the answers of the fast tier: %s\n", ex.what());
+            batch_stats.failed_escalations += escalated.size();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.requested += batch_stats.requested;
+    stats.answered_by_fast_tier += batch_stats.answered_by_fast_tier;
+    stats.escalated_unanswered += batch_stats.escalated_unanswered;
+    stats.escalated_low_confidence += batch_stats.escalated_low_confidence;
+    stats.escalated_conflicting += batch_stats.escalated_conflicting;
+    stats.answered_by_strong_tier += batch_stats.answered_by_strong_tier;
+    stats.failed_escalations += batch_stats.failed_escalations;
+
+    return answers;
+}
+
+
+/**
+ * @brief Finds the answers that contradict other answers of the same batch.
+ *
+ * Entries whose names share a template, e.g. invoice_2023-01.pdf and
+ * invoice_2024-07.pdf, should land in the same category. When the fast tier
+ * gave them different categories, all of them are marked.
+ *
+ * @param entries The entries of the batch.
+ * @param answers The answers of the fast tier, one per entry.
+ *
+ * @return One flag per entry, set for the conflicting ones.
+ */
+std::vector<bool> ModelRouter::find_conflicts(std::span<const FileEntry> entries,
+                                              const std::vector<std::optional<Categorization>>& answers) const
+{
+    std::vector<bool> conflicts(entries.size(), false);
+    std::unordered_map<std::string, std::vector<size_t>> groups;
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (!answers[i]) {
+            continue;
+        }
+        std::string key = NameTemplate::derive(entries[i].file_name);
+        if (!key.empty()) {
+            groups[key + (entries[i].type == FileType::File ? "\nF" : "\nD")].push_back(i);
+        }
+    }
+
+    for (const auto& [key, members] : groups) {
+        const std::string first = CategoryVocabulary::normalize(answers[members.front()]->category);
+        bool disagree = false;
+        for (size_t index : members) {
+            if (CategoryVocabulary::normalize(answers[index]->category) != first) {
+                disagree = true;
+                break;
+            }
+        }
+        if (disagree) {
+            for (size_t index : members) {
+                conflicts[index] = true;
+            }
+        }
+    }
+
+    return conflicts;
+}
+
+
+/**
+ * @brief Tells whether hard entries are escalated to a second model.
+ *
+ * @return true if a strong tier is configured.
+ */
+bool ModelRouter::has_strong_tier() const
+{
+    return strong_tier.has_value();
+}
+
+
+/**
+ * @brief Returns the routing decisions made so far.
+ *
+ * @return The counters accumulated over all batches sent through this router.
+ */
+ModelRouter::Stats ModelRouter::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+
+/**
+ * @brief Formats the routing decisions for the progress dialog and the log.
+ *
+ * @return A one-line summary of how many entries each tier answered and why
+ *         entries were escalated.
+ */
+std::string ModelRouter::format_stats() const
+{
+    Stats current = get_stats();
+    const size_t escalated = current.escalated_unanswered + current.escalated_low_confidence +
+                             current.escalated_conflicting;
+
+    std::ostringstream out;
+    out << "Model routing: " << current.requested << " entries, "
+        << current.answered_by_fast_tier << " answered by the fast tier, "
+        << escalated << " escalated ("
+        << current.escalated_low_confidence << " low confidence, "
+        << current.escalated_conflicting << " conflicting, "
+        << current.escalated_unanswered << " unanswered), "
+        << current.answered_by_strong_tier << " answered by the strong tier";
+    if (current.failed_escalations > 0) {
+        out << ", " << current.failed_escalations << " kept after a failed escalation";
+    }
+    return out.str();
+}
@@ -0,0 +1,218 @@
+#include "NameClassifier.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+
+/**
+ * @brief Adds a categorized name to the model, or removes one.
+ *
+ * Training is incremental: every call only touches the counts of the
+ * features of this name, so the model can follow the database row by row.
+ *
+ * @param file_name The name of the file or directory.
+ * @param file_type The type of the entry.
+ * @param categorization The category and subcategory the name belongs to.
+ * @param weight 1 to learn the example, -1 to forget an example learned earlier,
+ *               e.g. when the user recategorizes it.
+ */
+void NameClassifier::learn(const std::string &file_name, FileType file_type,
+                           const Categorization &categorization, int weight)
+{
+    if (categorization.category.empty() || weight == 0) {
+        return;
+    }
+
+    const std::vector<uint32_t> features = extract_features(file_name, file_type);
+    const std::string key = categorization.category + '\x1f' + categorization.subcategory;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto [it, inserted] = label_ids.try_emplace(key, static_cast<uint32_t>(labels.size()));
+    if (inserted) {
+        labels.push_back(Label{Categorization{categorization.category, categorization.subcategory}});
+    }
+    const uint32_t label_id = it->second;
+    Label &label = labels[label_id];
+
+    label.samples = std::max(0L, label.samples + weight);
+    label.feature_total = std::max(0L, label.feature_total + weight * static_cast<long>(features.size()));
+    total_samples = std::max(0L, total_samples + weight);
+
+    for (uint32_t feature : features) {
+        auto &counts = postings[feature];
+        auto count = std::find_if(counts.begin(), counts.end(),
+                                  [label_id](const auto &entry) { return entry.first == label_id; });
+        if (count == counts.end()) {
+            if (weight > 0) {
+                counts.emplace_back(label_id, weight);
+            }
+            continue;
+        }
+
+        count->second += weight;
+        if (count->second <= 0) {
+            counts.erase(count);
+            if (counts.empty()) {
+                postings.erase(feature);
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Predicts the categorization of a name with multinomial naive Bayes.
+ *
+ * Only the labels seen with the features of the name need more than their
+ * prior, so a prediction costs one pass over the postings of a few dozen
+ * features rather than a pass over the whole model.
+ *
+ * @param file_name The name of the file or directory.
+ * @param file_type The type of the entry.
+ *
+ * @return The most likely categorization, with the posterior probability of
+ *         its label as confidence, or an empty optional if nothing was learned yet.
+ */
+std::optional<Categorization> NameClassifier::predict(const std::string &file_name, FileType file_type) const
+{
+    const std::vector<uint32_t> features = extract_features(file_name, file_type);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (total_samples == 0) {
+        return std::nullopt;
+    }
+
+    const double vocabulary_size = static_cast<double>(std::max<size_t>(postings.size(), 1));
+    const double label_count = static_cast<double>(labels.size());
+    const double feature_count = static_cast<double>(features.size());
+
+    // Score of every label as if none of the features had been seen with it
+    std::vector<double> scores(labels.size(), -INFINITY);
+    for (size_t i = 0; i < labels.size(); ++i) {
+        if (labels[i].samples <= 0) {
+            continue;
+        }
+        const double prior = std::log((labels[i].samples + 1.0) / (total_samples + label_count));
+        const double denominator = labels[i].feature_total + SMOOTHING * vocabulary_size;
+        scores[i] = prior + feature_count * (std::log(SMOOTHING) - std::log(denominator));
+    }
+
+    for (uint32_t feature : features) {
+        auto it = postings.find(feature);
+        if (it == postings.end()) {
+            continue;
+        }
+        for (const auto &[label_id, count] : it->second) {
+            scores[label_id] += std::log(count + SMOOTHING) - std::log(SMOOTHING);
+        }
+    }
+
+    auto best = std::max_element(scores.begin(), scores.end());
+    if (best == scores.end() || std::isinf(*best)) {
+        return std::nullopt;
+    }
+
+    double normalizer = 0.0;
+    for (double score : scores) {
+        if (!std::isinf(score)) {
+            normalizer += std::exp(score - *best);
+        }
+    }
+
+    Categorization prediction = labels[best - scores.begin()].categorization;
+    prediction.confidence = 1.0 / normalizer;
+    return prediction;
+}
+
+
+/**
+ * @brief Returns the number of examples the model currently holds.
+ */
+size_t NameClassifier::sample_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<size_t>(total_samples);
+}
+
+
+/**
+ * @brief Turns a name into hashed features.
+ *
+ * The features are the entry type, the extension, the words of the name
+ * (split at anything that is not a letter or digit, and at lower-to-upper
+ * case changes, without pure numbers), and the character trigrams of the
+ * lower-cased name without its extension, with digits folded into '#'.
+ *
+ * @param file_name The name of the file or directory.
+ * @param file_type The type of the entry.
+ *
+ * @return The feature hashes, one per occurrence.
+ */
+std::vector<uint32_t> NameClassifier::extract_features(const std::string &file_name, FileType file_type)
+{
+    std::vector<uint32_t> features;
+    features.push_back(hash_feature(file_type == FileType::File ? "t:F" : "t:D"));
+
+    auto lower = [](unsigned char c) { return static_cast<char>(std::tolower(c)); };
+
+    std::string stem = file_name;
+    if (file_type == FileType::File) {
+        const size_t dot = file_name.rfind('.');
+        if (dot != std::string::npos && dot > 0 && dot + 1 < file_name.size()) {
+            std::string extension = file_name.substr(dot + 1);
+            std::transform(extension.begin(), extension.end(), extension.begin(), lower);
+            features.push_back(hash_feature("e:" + extension));
+            stem = file_name.substr(0, dot);
+        }
+    }
+
+    std::string word;
+    bool has_letter = false;
+    auto flush_word = [&]() {
+        if (has_letter && word.size() > 1) {
+            features.push_back(hash_feature("w:" + word));
+        }
+        word.clear();
+        has_letter = false;
+    };
+
+    for (size_t i = 0; i < stem.size(); ++i) {
+        const unsigned char c = stem[i];
+        if (!std::isalnum(c) && c < 0x80) {
+            flush_word();
+            continue;
+        }
+        if (std::isupper(c) && i > 0 && std::islower(static_cast<unsigned char>(stem[i - 1]))) {
+            flush_word();
+        }
+        has_letter = has_letter || std::isalpha(c) || c >= 0x80;
+        word += lower(c);
+    }
+    flush_word();
+
+    std::string folded = "^";
+    for (unsigned char c : stem) {
+        folded += std::isdigit(c) ? '#' : lower(c);
+    }
+    folded += '$';
+    for (size_t i = 0; i + 3 <= folded.size(); ++i) {
+        features.push_back(hash_feature("g:" + folded.substr(i, 3)));
+    }
+
+    return features;
+}
+
+
+/**
+ * @brief Hashes a feature name into one of 2^FEATURE_BITS buckets (32-bit FNV-1a).
+ */
+uint32_t NameClassifier::hash_feature(const std::string &feature)
+{
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : feature) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash & ((1u << FEATURE_BITS) - 1);
+}
@@ -0,0 +1,269 @@
+#include "NameTemplate.hpp"
+#include <algorithm>
+#include <cctype>
+
+
+// Names with fewer literal letters than this are too generic to share a categorization
+static constexpr int MIN_LITERAL_LETTERS = 3;
+
+
+/**
+ * @brief Derives the template key of a file or directory name.
+ *
+ * The name is case-folded and its variable parts are masked, so that names
+ * produced by the same source share one key:
+ *
+ *   Invoice_2024_01.pdf                    -> invoice_<date>.pdf
+ *   setup-1.2.4.exe                        -> setup-<ver>.exe
+ *   report 7f3a9c0e12d4b5a6.txt            -> report <hash>.txt
+ *   export-123e4567-e89b-12d3-a456-426614174000.csv -> export-<uuid>.csv
+ *   IMG_20240105_1234.jpg                  -> img_<date>_#.jpg
+ *
+ * The extension is kept as is.
+ *
+ * @param file_name The name to derive the key from.
+ * @return The template key, or an empty string if nothing was masked or too
+ *         little of the name is left to identify its source.
+ */
+std::string NameTemplate::derive(const std::string &file_name)
+{
+    std::string name = file_name;
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    std::string extension;
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos && dot > 0 && name.size() - dot <= 6) {
+        std::string candidate = name.substr(dot + 1);
+        bool is_alnum = std::all_of(candidate.begin(), candidate.end(),
+                                    [](unsigned char c) { return std::isalnum(c); });
+        bool has_alpha = std::any_of(candidate.begin(), candidate.end(),
+                                     [](unsigned char c) { return std::isalpha(c); });
+        if (!candidate.empty() && is_alnum && has_alpha) {
+            extension = name.substr(dot);
+            name.resize(dot);
+        }
+    }
+
+    std::string key;
+    key.reserve(name.size() + extension.size());
+    bool masked = false;
+    int literal_letters = 0;
+
+    for (size_t pos = 0; pos < name.size();) {
+        size_t end;
+        if ((end = match_uuid(name, pos)) != pos) {
+            key += "<uuid>";
+        } else if ((end = match_hash(name, pos)) != pos) {
+            key += "<hash>";
+        } else if ((end = match_date(name, pos)) != pos) {
+            key += "<date>";
+        } else if ((end = match_version(name, pos)) != pos) {
+            key += "<ver>";
+        } else if ((end = match_digits(name, pos)) != pos) {
+            key += "#";
+        } else {
+            if (std::isalpha(static_cast<unsigned char>(name[pos]))) {
+                ++literal_letters;
+            }
+            key += name[pos++];
+            continue;
+        }
+        masked = true;
+        pos = end;
+    }
+
+    if (!masked || literal_letters < MIN_LITERAL_LETTERS) {
+        return "";
+    }
+
+    return key + extension;
+}
+
+
+/**
+ * @brief Tells whether a token may start at pos, i.e. it does not continue a word or number.
+ */
+bool NameTemplate::is_boundary(const std::string &text, size_t pos)
+{
+    return pos == 0 || !std::isalnum(static_cast<unsigned char>(text[pos - 1]));
+}
+
+
+/**
+ * @brief Matches a UUID such as 123e4567-e89b-12d3-a456-426614174000.
+ *
+ * @return The position after the match, or pos if there is none.
+ */
+size_t NameTemplate::match_uuid(const std::string &text, size_t pos)
+{
+    static constexpr size_t group_lengths[] = {8, 4, 4, 4, 12};
+
+    if (!is_boundary(text, pos)) {
+        return pos;
+    }
+
+    size_t end = pos;
+    for (size_t group = 0; group < 5; ++group) {
+        if (group > 0) {
+            if (end >= text.size() || text[end] != '-') {
+                return pos;
+            }
+            ++end;
+        }
+        for (size_t i = 0; i < group_lengths[group]; ++i, ++end) {
+            if (end >= text.size() || !std::isxdigit(static_cast<unsigned char>(text[end]))) {
+                return pos;
+            }
+        }
+    }
+
+    if (end < text.size() && std::isalnum(static_cast<unsigned char>(text[end]))) {
+        return pos;
+    }
+    return end;
+}
+
+
+/**
+ * @brief Matches a hexadecimal hash of at least 16 digits, e.g. a commit or content hash.
+ *
+ * @return The position after the match, or pos if there is none.
+ */
+size_t NameTemplate::match_hash(const std::string &text, size_t pos)
+{
+    if (!is_boundary(text, pos)) {
+        return pos;
+    }
+
+    size_t end = pos;
+    bool has_digit = false;
+    while (end < text.size() && std::isxdigit(static_cast<unsigned char>(text[end]))) {
+        has_digit = has_digit || std::isdigit(static_cast<unsigned char>(text[end]));
+        ++end;
+    }
+
+    if (end - pos < 16 || !has_digit ||
+        (end < text.size() && std::isalnum(static_cast<unsigned char>(text[end])))) {
+        return pos;
+    }
+    return end;
+}
+
+
+/**
+ * @brief Matches a date starting with a 19xx or 20xx year.
+ *
+ * Accepted forms are a year followed by one or two one- or two-digit parts
+ * joined by the same '-', '_' or '.' (2024-01-15, 2024_01), and the compact
+ * forms YYYYMMDD and YYYYMMDDhhmmss.
+ *
+ * @return The position after the match, or pos if there is none.
+ */
+size_t NameTemplate::match_date(const std::string &text, size_t pos)
+{
+    auto is_digit_at = [&text](size_t i) {
+        return i < text.size() && std::isdigit(static_cast<unsigned char>(text[i]));
+    };
+
+    if (!is_boundary(text, pos) || !is_digit_at(pos)) {
+        return pos;
+    }
+
+    size_t run_end = pos;
+    while (is_digit_at(run_end)) {
+        ++run_end;
+    }
+
+    const bool has_year_prefix = text.compare(pos, 2, "19") == 0 || text.compare(pos, 2, "20") == 0;
+    if (!has_year_prefix) {
+        return pos;
+    }
+
+    const size_t run_length = run_end - pos;
+    if (run_length == 8 || run_length == 14) {
+        int month = std::stoi(text.substr(pos + 4, 2));
+        int day = std::stoi(text.substr(pos + 6, 2));
+        return (month >= 1 && month <= 12 && day >= 1 && day <= 31) ? run_end : pos;
+    }
+
+    if (run_length != 4 || run_end >= text.size()) {
+        return pos;
+    }
+
+    const char separator = text[run_end];
+    if (separator != '-' && separator != '_' && separator != '.') {
+        return pos;
+    }
+
+    size_t end = run_end;
+    int parts = 0;
+    while (parts < 2 && end < text.size() && text[end] == separator && is_digit_at(end + 1)) {
+        size_t part_end = end + 1;
+        while (is_digit_at(part_end)) {
+            ++part_end;
+        }
+        if (part_end - end - 1 > 2) {
+            break;
+        }
+        end = part_end;
+        ++parts;
+    }
+
+    return parts > 0 ? end : pos;
+}
+
+
+/**
+ * @brief Matches a version such as 1.2.3 or v10.0, with at least two dotted parts.
+ *
+ * @return The position after the match, or pos if there is none.
+ */
+size_t NameTemplate::match_version(const std::string &text, size_t pos)
+{
+    auto is_digit_at = [&text](size_t i) {
+        return i < text.size() && std::isdigit(static_cast<unsigned char>(text[i]));
+    };
+
+    if (!is_boundary(text, pos)) {
+        return pos;
+    }
+
+    size_t end = pos;
+    if (text[end] == 'v' && is_digit_at(end + 1)) {
+        ++end;
+    }
+    if (!is_digit_at(end)) {
+        return pos;
+    }
+
+    int parts = 0;
+    while (true) {
+        while (is_digit_at(end)) {
+            ++end;
+        }
+        ++parts;
+        if (end < text.size() && text[end] == '.' && is_digit_at(end + 1)) {
+            ++end;
+        } else {
+            break;
+        }
+    }
+
+    return parts >= 2 ? end : pos;
+}
+
+
+/**
+ * @brief Matches a run of decimal digits.
+ *
+ * @return The position after the match, or pos if there is none.
+ */
+size_t NameTemplate::match_digits(const std::string &text, size_t pos)
+{
+    size_t end = pos;
+    while (end < text.size() && std::isdigit(static_cast<unsigned char>(text[end]))) {
+        ++end;
+    }
+    return end;
+}
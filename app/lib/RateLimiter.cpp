@@ -0,0 +1,161 @@
+#include "RateLimiter.hpp"
+#include "RetryPolicy.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+
+/**
+ * @brief Constructs a limiter with one token bucket for requests and one for tokens.
+ *
+ * Both buckets start full and refill continuously at their per-minute rate.
+ *
+ * @param requests_per_minute The number of requests allowed per minute.
+ * @param tokens_per_minute The number of LLM tokens allowed per minute.
+ */
+RateLimiter::RateLimiter(double requests_per_minute, double tokens_per_minute)
+    : requests{requests_per_minute, requests_per_minute, requests_per_minute / 60.0},
+      tokens{tokens_per_minute, tokens_per_minute, tokens_per_minute / 60.0},
+      last_refill(Clock::now()),
+      paused_until(Clock::now())
+{}
+
+
+/**
+ * @brief Blocks until one request carrying the given number of tokens may be sent.
+ *
+ * Requests larger than the token bucket are clamped to its capacity, so they
+ * wait for a full bucket instead of forever.
+ *
+ * @param token_count The estimated number of tokens of the request.
+ * @param cancel_flag The flag that aborts the wait when raised, or nullptr.
+ *
+ * @return true once capacity has been taken, false if the wait was cancelled.
+ */
+bool RateLimiter::acquire(double token_count, const std::atomic<bool>* cancel_flag)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        if (cancel_flag && cancel_flag->load()) {
+            return false;
+        }
+
+        const auto now = Clock::now();
+        refill(now);
+
+        const double needed_tokens = std::min(token_count, tokens.capacity);
+        auto wait_time = std::chrono::duration<double>(0);
+
+        if (now < paused_until) {
+            wait_time = paused_until - now;
+        } else {
+            if (requests.available < 1.0) {
+                wait_time = std::max(wait_time, std::chrono::duration<double>(
+                    (1.0 - requests.available) / requests.refill_per_second));
+            }
+            if (tokens.available < needed_tokens) {
+                wait_time = std::max(wait_time, std::chrono::duration<double>(
+                    (needed_tokens - tokens.available) / tokens.refill_per_second));
+            }
+        }
+
+        if (wait_time.count() <= 0) {
+            requests.available -= 1.0;
+            tokens.available -= needed_tokens;
+            return true;
+        }
+
+        // Wake up regularly to notice a raised cancel flag
+        condition.wait_for(lock, std::min<std::chrono::duration<double>>(wait_time, std::chrono::milliseconds(200)));
+    }
+}
+
+
+/**
+ * @brief Returns tokens that were reserved by acquire() but not used.
+ *
+ * @param token_count The difference between the estimated and the actual usage.
+ *                    A negative value charges extra tokens.
+ */
+void RateLimiter::release_unused(double token_count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    tokens.available = std::min(tokens.capacity, tokens.available + token_count);
+    condition.notify_all();
+}
+
+
+/**
+ * @brief Stops all requests from being sent for the given time.
+ *
+ * This is used after a 429 response so that the other workers back off too,
+ * instead of running into the same limit.
+ *
+ * @param delay How long to hold back requests.
+ */
+void RateLimiter::pause_for(std::chrono::milliseconds delay)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    paused_until = std::max(paused_until, Clock::now() + delay);
+}
+
+
+/**
+ * @brief Aligns the buckets with the limits reported by the server.
+ *
+ * OpenAI-compatible servers report x-ratelimit-limit-*, x-ratelimit-remaining-*
+ * and x-ratelimit-reset-* headers for requests and tokens. A lower limit than
+ * the configured one is adopted, and a bucket never holds more than the server
+ * says is remaining.
+ *
+ * @param response A response received from the API.
+ */
+void RateLimiter::update_from_headers(const HttpResponse& response)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    refill(Clock::now());
+    update_bucket(requests, response, "requests");
+    update_bucket(tokens, response, "tokens");
+}
+
+
+void RateLimiter::refill(Clock::time_point now)
+{
+    const double elapsed = std::chrono::duration<double>(now - last_refill).count();
+    last_refill = now;
+
+    requests.available = std::min(requests.capacity, requests.available + elapsed * requests.refill_per_second);
+    tokens.available = std::min(tokens.capacity, tokens.available + elapsed * tokens.refill_per_second);
+}
+
+
+void RateLimiter::update_bucket(Bucket& bucket, const HttpResponse& response, const std::string& kind)
+{
+    const std::string limit = response.get_header("x-ratelimit-limit-" + kind);
+    if (!limit.empty()) {
+        double value = std::strtod(limit.c_str(), nullptr);
+        if (value > 0 && value < bucket.capacity) {
+            bucket.capacity = value;
+            bucket.refill_per_second = value / 60.0;
+        }
+    }
+
+    const std::string remaining = response.get_header("x-ratelimit-remaining-" + kind);
+    if (!remaining.empty()) {
+        double value = std::strtod(remaining.c_str(), nullptr);
+        if (value >= 0) {
+            bucket.available = std::min(bucket.available, value);
+        }
+    }
+
+    // When the server says the window resets sooner than our refill rate
+    // assumes, refill accordingly so that we do not wait needlessly.
+    auto reset = RetryPolicy::parse_duration(response.get_header("x-ratelimit-reset-" + kind));
+    if (reset && reset->count() > 0 && bucket.available < bucket.capacity) {
+        const double seconds = reset->count() / 1000.0;
+        bucket.refill_per_second = std::max(bucket.capacity / 60.0,
+                                            (bucket.capacity - bucket.available) / seconds);
+    } else {
+        bucket.refill_per_second = bucket.capacity / 60.0;
+    }
+}
@@ -0,0 +1,203 @@
+#include "RetryPolicy.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+
+/**
+ * @brief Constructs a retry policy with capped, jittered exponential backoff.
+ *
+ * @param max_attempts The total number of attempts, including the first one.
+ * @param base_delay The backoff ceiling for the first retry. It doubles on every retry.
+ * @param max_delay The largest delay ever waited between two attempts.
+ */
+RetryPolicy::RetryPolicy(int max_attempts,
+                         std::chrono::milliseconds base_delay,
+                         std::chrono::milliseconds max_delay)
+    : max_attempts(std::max(1, max_attempts)),
+      base_delay(base_delay),
+      max_delay(max_delay)
+{}
+
+
+/**
+ * @brief Returns the total number of attempts a request may take.
+ */
+int RetryPolicy::get_max_attempts() const
+{
+    return max_attempts;
+}
+
+
+/**
+ * @brief Computes how long to wait before the next attempt.
+ *
+ * If the server said when to come back (Retry-After, retry-after-ms or the
+ * x-ratelimit-reset-* headers), that delay is used, plus a little jitter so that
+ * concurrent workers do not all retry in the same instant. Otherwise a "full
+ * jitter" backoff is used: a random delay between zero and
+ * base_delay * 2^(attempt - 1), capped at max_delay.
+ *
+ * @param attempt The number of the attempt that just failed, starting at 1.
+ * @param response The failed response, if the server answered at all.
+ *
+ * @return The delay to wait before the next attempt.
+ */
+std::chrono::milliseconds RetryPolicy::next_delay(int attempt, const HttpResponse* response) const
+{
+    thread_local std::mt19937 generator{std::random_device{}()};
+
+    if (response) {
+        if (auto server_delay = parse_retry_after(*response)) {
+            std::uniform_int_distribution<long long> jitter(0, 250);
+            return std::min(max_delay, *server_delay + std::chrono::milliseconds(jitter(generator)));
+        }
+    }
+
+    const int exponent = std::clamp(attempt - 1, 0, 20);
+    const long long ceiling = std::min<long long>(max_delay.count(), base_delay.count() << exponent);
+    std::uniform_int_distribution<long long> distribution(0, std::max<long long>(ceiling, 1));
+    return std::chrono::milliseconds(distribution(generator));
+}
+
+
+/**
+ * @brief Tells whether a request that failed with the given status may be retried.
+ *
+ * Rate limiting (429), request timeouts (408), conflicts (409) and transient
+ * server errors are retried. Every other error is returned to the caller.
+ */
+bool RetryPolicy::is_retryable_status(long status_code)
+{
+    switch (status_code) {
+        case 408:
+        case 409:
+        case 429:
+        case 500:
+        case 502:
+        case 503:
+        case 504:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+/**
+ * @brief Extracts the delay requested by the server from the response headers.
+ *
+ * retry-after-ms and Retry-After (in seconds) are preferred. Without them, the
+ * longer of x-ratelimit-reset-requests and x-ratelimit-reset-tokens is used if
+ * the matching x-ratelimit-remaining-* header shows that the limit is exhausted.
+ *
+ * @param response The failed response.
+ *
+ * @return The requested delay, or an empty optional if the server gave none.
+ */
+std::optional<std::chrono::milliseconds> RetryPolicy::parse_retry_after(const HttpResponse& response)
+{
+    const std::string retry_after_ms = response.get_header("retry-after-ms");
+    if (!retry_after_ms.empty()) {
+        char* end = nullptr;
+        double value = std::strtod(retry_after_ms.c_str(), &end);
+        if (end != retry_after_ms.c_str() && value >= 0) {
+            return std::chrono::milliseconds(static_cast<long long>(value));
+        }
+    }
+
+    const std::string retry_after = response.get_header("retry-after");
+    if (!retry_after.empty()) {
+        char* end = nullptr;
+        double value = std::strtod(retry_after.c_str(), &end);
+        if (end != retry_after.c_str() && value >= 0) {
+            return std::chrono::milliseconds(static_cast<long long>(value * 1000));
+        }
+    }
+
+    std::optional<std::chrono::milliseconds> delay;
+    for (const char* kind : {"requests", "tokens"}) {
+        if (response.get_header(std::string("x-ratelimit-remaining-") + kind) != "0") {
+            continue;
+        }
+        if (auto reset = parse_duration(response.get_header(std::string("x-ratelimit-reset-") + kind))) {
+            delay = delay ? std::max(*delay, *reset) : *reset;
+        }
+    }
+
+    return delay;
+}
+
+
+/**
+ * @brief Parses a duration such as "20ms", "1s", "6m0s" or "1h2m3.5s".
+ *
+ * This is the format used by the x-ratelimit-reset-* headers.
+ *
+ * @param value The duration string.
+ *
+ * @return The duration, or an empty optional if the string is not a duration.
+ */
+std::optional<std::chrono::milliseconds> RetryPolicy::parse_duration(const std::string& value)
+{
+    double total_ms = 0;
+    const char* cursor = value.c_str();
+    bool parsed_any = false;
+
+    while (*cursor) {
+        char* end = nullptr;
+        double number = std::strtod(cursor, &end);
+        if (end == cursor) {
+            return std::nullopt;
+        }
+        cursor = end;
+
+        if (cursor[0] == 'm' && cursor[1] == 's') {
+            total_ms += number;
+            cursor += 2;
+        } else if (cursor[0] == 'h') {
+            total_ms += number * 3600000;
+            cursor += 1;
+        } else if (cursor[0] == 'm') {
+            total_ms += number * 60000;
+            cursor += 1;
+        } else if (cursor[0] == 's' || cursor[0] == '\0') {
+            total_ms += number * 1000;
+            cursor += (cursor[0] == 's') ? 1 : 0;
+        } else {
+            return std::nullopt;
+        }
+        parsed_any = true;
+    }
+
+    if (!parsed_any) {
+        return std::nullopt;
+    }
+    return std::chrono::milliseconds(static_cast<long long>(total_ms));
+}
+
+
+/**
+ * @brief Sleeps for the given delay, waking up early if the cancel flag is raised.
+ *
+ * @param delay How long to sleep.
+ * @param cancel_flag The flag to watch, or nullptr.
+ *
+ * @return true if the full delay elapsed, false if the wait was cancelled.
+ */
+bool RetryPolicy::wait(std::chrono::milliseconds delay, const std::atomic<bool>* cancel_flag)
+{
+    const auto deadline = std::chrono::steady_clock::now() + delay;
+    const auto slice = std::chrono::milliseconds(100);
+
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (cancel_flag && cancel_flag->load()) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+            slice, deadline - std::chrono::steady_clock::now()));
+    }
+
+    return !(cancel_flag && cancel_flag->load());
+}
@@ -0,0 +1,307 @@
+#include "RuleEngine.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+
+static const char* DEFAULT_RULES = R"(# AI File Sorter local categorization rules
+#
+# Files matched by a rule are categorized locally, without asking the AI.
+# One rule per line, in the form:
+#
+#   <kind> <pattern> = <Category> : <Subcategory>
+#
+#   ext    a file extension, without the dot (case-insensitive), e.g. "ext tar.gz"
+#   glob   the whole name, with * and ? wildcards (case-insensitive), e.g. "glob invoice_*.pdf"
+#   regex  the whole name, as an ECMAScript regular expression (case-insensitive)
+#
+# glob and regex rules also apply to directories. They are tried in file
+# order and take precedence over ext rules, which only apply to files.
+
+ext pdf = Documents : PDFs
+ext doc = Documents : Word Documents
+ext docx = Documents : Word Documents
+ext odt = Documents : Text Documents
+ext rtf = Documents : Text Documents
+ext txt = Documents : Text Files
+ext md = Documents : Markdown
+ext epub = Books : E-books
+ext mobi = Books : E-books
+ext xls = Spreadsheets : Excel
+ext xlsx = Spreadsheets : Excel
+ext ods = Spreadsheets : OpenDocument
+ext csv = Spreadsheets : CSV Data
+ext ppt = Presentations : PowerPoint
+ext pptx = Presentations : PowerPoint
+ext odp = Presentations : OpenDocument
+ext jpg = Images : Photos
+ext jpeg = Images : Photos
+ext heic = Images : Photos
+ext png = Images : Graphics
+ext gif = Images : Animations
+ext webp = Images : Graphics
+ext svg = Images : Vector Graphics
+ext mp3 = Music : MP3
+ext flac = Music : Lossless
+ext ogg = Music : Ogg
+ext wav = Audio : Recordings
+ext mp4 = Videos : MP4
+ext mkv = Videos : Matroska
+ext mov = Videos : QuickTime
+ext avi = Videos : AVI
+ext webm = Videos : WebM
+ext zip = Archives : ZIP
+ext rar = Archives : RAR
+ext 7z = Archives : 7-Zip
+ext tar = Archives : Tarballs
+ext tar.gz = Archives : Tarballs
+ext tgz = Archives : Tarballs
+ext tar.xz = Archives : Tarballs
+ext deb = Installers : Debian Packages
+ext rpm = Installers : RPM Packages
+ext iso = Disk Images : ISO
+ext img = Disk Images : Raw Images
+ext dmg = Disk Images : macOS
+ext torrent = Torrents : Torrent Files
+)";
+
+
+/**
+ * @brief Constructs a RuleEngine and loads the rules from the configuration directory.
+ *
+ * @param config_dir The directory holding categorization_rules.txt. A file with
+ *                   common extension rules is created there if none exists.
+ */
+RuleEngine::RuleEngine(const std::string &config_dir)
+    : rules_file(config_dir + "/categorization_rules.txt")
+{
+    load();
+}
+
+
+/**
+ * @brief Reads and compiles the rules file.
+ *
+ * Extension rules are compiled into a hash map keyed by the lower-cased
+ * extension, so they cost one lookup per candidate extension. Glob and regex
+ * rules are kept in file order and compiled once. Invalid lines are reported
+ * and skipped.
+ *
+ * @return true if the rules file was read, false otherwise.
+ */
+bool RuleEngine::load()
+{
+    if (!std::filesystem::exists(rules_file) && !write_default_rules()) {
+        return false;
+    }
+
+    std::ifstream file(rules_file);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open rules file: " << rules_file << std::endl;
+        return false;
+    }
+
+    extension_rules.clear();
+    pattern_rules.clear();
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        if (!parse_rule(line, line_number)) {
+            std::cerr << "Ignoring invalid rule at " << rules_file << ":" << line_number << std::endl;
+        }
+    }
+
+    std::error_code ec;
+    loaded_write_time = std::filesystem::last_write_time(rules_file, ec);
+    return true;
+}
+
+
+/**
+ * @brief Reloads the rules if the rules file was modified since it was loaded.
+ *
+ * This lets users edit the rules between two analyses without restarting.
+ */
+void RuleEngine::reload_if_changed()
+{
+    std::error_code ec;
+    auto write_time = std::filesystem::last_write_time(rules_file, ec);
+    if (ec || write_time != loaded_write_time) {
+        load();
+    }
+}
+
+
+/**
+ * @brief Finds the categorization of an entry from the rules.
+ *
+ * Glob and regex rules are tried first, in file order. For files, the
+ * extension rules are then looked up from the longest extension to the
+ * shortest, so "archive.tar.gz" checks "tar.gz" before "gz".
+ *
+ * @param entry The file or directory to categorize.
+ *
+ * @return The categorization of the first matching rule, or an empty optional.
+ */
+std::optional<Categorization> RuleEngine::match(const FileEntry &entry) const
+{
+    const std::string name = to_lower(entry.file_name);
+
+    for (const auto &rule : pattern_rules) {
+        bool matched = (rule.kind == PatternKind::Glob)
+                       ? glob_match(rule.pattern, name)
+                       : std::regex_match(entry.file_name, rule.regex);
+        if (matched) {
+            return rule.categorization;
+        }
+    }
+
+    if (entry.type != FileType::File || extension_rules.empty()) {
+        return std::nullopt;
+    }
+
+    // Skip a leading dot, so ".bashrc" has no extension
+    size_t dot_pos = name.find('.', 1);
+    while (dot_pos != std::string::npos) {
+        auto it = extension_rules.find(name.substr(dot_pos + 1));
+        if (it != extension_rules.end()) {
+            return it->second;
+        }
+        dot_pos = name.find('.', dot_pos + 1);
+    }
+
+    return std::nullopt;
+}
+
+
+/**
+ * @brief Returns the number of compiled rules.
+ */
+size_t RuleEngine::get_rule_count() const
+{
+    return extension_rules.size() + pattern_rules.size();
+}
+
+
+bool RuleEngine::write_default_rules() const
+{
+    std::ofstream file(rules_file);
+    if (!file.is_open()) {
+        std::cerr << "Failed to create rules file: " << rules_file << std::endl;
+        return false;
+    }
+
+    file << DEFAULT_RULES;
+    return true;
+}
+
+
+/**
+ * @brief Parses one "<kind> <pattern> = <Category> : <Subcategory>" line.
+ *
+ * @param line The trimmed line.
+ * @param line_number The line number, for error messages.
+ *
+ * @return true if the line was a valid rule and has been added.
+ */
+bool RuleEngine::parse_rule(const std::string &line, int line_number)
+{
+    size_t kind_end = line.find_first_of(" \t");
+    size_t separator_pos = line.rfind(" = ");
+    if (kind_end == std::string::npos || separator_pos == std::string::npos || separator_pos <= kind_end) {
+        return false;
+    }
+
+    std::string kind = to_lower(line.substr(0, kind_end));
+    std::string pattern = line.substr(kind_end, separator_pos - kind_end);
+    pattern.erase(0, pattern.find_first_not_of(" \t"));
+    pattern.erase(pattern.find_last_not_of(" \t") + 1);
+
+    std::string target = line.substr(separator_pos + 3);
+    Categorization categorization;
+    size_t colon_pos = target.find(" : ");
+    if (colon_pos != std::string::npos) {
+        categorization.category = target.substr(0, colon_pos);
+        categorization.subcategory = target.substr(colon_pos + 3);
+    } else {
+        categorization.category = target;
+    }
+
+    if (pattern.empty() || categorization.category.empty()) {
+        return false;
+    }
+
+    if (kind == "ext") {
+        if (pattern[0] == '.') {
+            pattern.erase(0, 1);
+        }
+        extension_rules.try_emplace(to_lower(pattern), categorization);
+    } else if (kind == "glob") {
+        pattern_rules.push_back({PatternKind::Glob, to_lower(pattern), std::regex(), categorization});
+    } else if (kind == "regex") {
+        try {
+            std::regex regex(pattern, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+            pattern_rules.push_back({PatternKind::Regex, pattern, std::move(regex), categorization});
+        } catch (const std::regex_error &e) {
+            std::cerr << "Invalid regex at line " << line_number << ": " << e.what() << std::endl;
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+
+std::string RuleEngine::to_lower(const std::string &text)
+{
+    std::string result = text;
+    std::transform(result.begin(), result.end(), result.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return result;
+}
+
+
+/**
+ * @brief Matches a whole string against a glob pattern with * and ? wildcards.
+ *
+ * Uses the linear-time backtracking algorithm that only remembers the last star.
+ */
+bool RuleEngine::glob_match(const std::string &pattern, const std::string &text)
+{
+    size_t p = 0, t = 0;
+    size_t star = std::string::npos, star_text = 0;
+
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            ++p;
+            ++t;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            star_text = t;
+        } else if (star != std::string::npos) {
+            p = star + 1;
+            t = ++star_text;
+        } else {
+            return false;
+        }
+    }
+
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+
+    return p == pattern.size();
+}
@@ -1,4 +1,5 @@
 #include "Settings.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
 #include <glib.h>
@@ -8,6 +9,20 @@
 #endif
 
 
+/**
+ * The backend of the strong routing tier when [LLM.Strong] does not override it.
+ */
+static LLMBackend default_strong_backend()
+{
+    LLMBackend backend;
+    backend.model = "gpt-4o";
+    backend.timeout_seconds = 30;
+    backend.prompt_price_per_million = 2.50;
+    backend.completion_price_per_million = 10.00;
+    return backend;
+}
+
+
 /**
  * Constructor for the Settings class.
  *
@@ -24,7 +39,21 @@ Settings::Settings()
       categorize_files(true),
       categorize_directories(false),
       default_sort_folder(""),
-      sort_folder("")
+      sort_folder(""),
+      max_concurrent_requests(4),
+      batch_size(20),
+      max_retries(5),
+      requests_per_minute(500),
+      tokens_per_minute(200000),
+      routing_enabled(false),
+      strong_llm_backend(default_strong_backend()),
+      escalation_threshold(0.7),
+      escalate_conflicts(true),
+      classifier_enabled(false),
+      classifier_min_confidence(0.9),
+      classifier_min_samples(200),
+      cassette_mode("off"),
+      cassette_latency_ms(0)
 {
     const std::string app_name = "AIFileSorter";
     config_path = define_config_path();
@@ -43,6 +72,7 @@ Settings::Settings()
         default_sort_folder = g_get_home_dir();
     }
     sort_folder = default_sort_folder;
+    cassette_path = (config_dir / "llm_cassette.bin").string();
 }
 
 /**
@@ -103,10 +133,121 @@ bool Settings::load() {
     sort_folder = config.getValue("Settings", "SortFolder", default_sort_folder ? default_sort_folder : "/");
     skipped_version = config.getValue("Settings", "SkippedVersion", "0.0.0");
 
+    max_concurrent_requests = get_int_value("Settings", "MaxConcurrentRequests", 4);
+    batch_size = get_int_value("Settings", "BatchSize", 20);
+    max_retries = get_int_value("Settings", "MaxRetries", 5);
+    requests_per_minute = get_int_value("Settings", "RequestsPerMinute", 500);
+    tokens_per_minute = get_int_value("Settings", "TokensPerMinute", 200000);
+
+    llm_backend = read_llm_backend("LLM");
+
+    routing_enabled = config.getValue("Routing", "Enabled", "false") == "true";
+    strong_llm_backend = read_llm_backend("LLM.Strong", default_strong_backend());
+    escalation_threshold = get_double_value("Routing", "EscalationThreshold", 0.7);
+    escalate_conflicts = config.getValue("Routing", "EscalateConflicts", "true") == "true";
+
+    classifier_enabled = config.getValue("Classifier", "Enabled", "false") == "true";
+    classifier_min_confidence = get_double_value("Classifier", "MinConfidence", 0.9);
+    classifier_min_samples = get_int_value("Classifier", "MinSamples", 200);
+
+    cassette_mode = config.getValue("Cassette", "Mode", "off");
+    cassette_path = config.getValue("Cassette", "Path", (config_dir / "llm_cassette.bin").string());
+    cassette_latency_ms = get_int_value("Cassette", "LatencyMs", 0);
+
     return true;
 }
 
 
+/**
+ * Reads an integer from the configuration file.
+ *
+ * @param section The section holding the key.
+ * @param key The key to read.
+ * @param default_value The value to return if the key is missing or not a number.
+ * @return The configured value, or default_value.
+ */
+int Settings::get_int_value(const std::string &section, const std::string &key, int default_value) const
+{
+    try {
+        return std::stoi(config.getValue(section, key, std::to_string(default_value)));
+    } catch (const std::exception&) {
+        return default_value;
+    }
+}
+
+
+/**
+ * Reads a decimal number from the configuration file.
+ *
+ * @param section The section holding the key.
+ * @param key The key to read.
+ * @param default_value The value to return if the key is missing or not a number.
+ * @return The configured value, or default_value.
+ */
+double Settings::get_double_value(const std::string &section, const std::string &key, double default_value) const
+{
+    try {
+        return std::stod(config.getValue(section, key, std::to_string(default_value)));
+    } catch (const std::exception&) {
+        return default_value;
+    }
+}
+
+
+/**
+ * Reads an LLM backend description from the configuration file.
+ *
+ * Missing keys keep the given defaults, by default those of LLMBackend, which
+ * point at the OpenAI API. Setting BaseUrl to e.g. http://localhost:11434/v1 targets a local
+ * OpenAI-compatible server such as Ollama, llama.cpp or vLLM.
+ *
+ * @param section The section holding the BaseUrl, Model, AuthHeader, ApiKey,
+ *                TimeoutSeconds, PromptPricePerMillion, CompletionPricePerMillion
+ *                and StructuredOutput keys.
+ * @param defaults The backend to take missing keys from.
+ * @return The configured backend.
+ */
+LLMBackend Settings::read_llm_backend(const std::string &section, const LLMBackend &defaults) const
+{
+    LLMBackend backend = defaults;
+    backend.base_url = config.getValue(section, "BaseUrl", backend.base_url);
+    backend.model = config.getValue(section, "Model", backend.model);
+    backend.auth_header = config.getValue(section, "AuthHeader", backend.auth_header);
+    backend.api_key = config.getValue(section, "ApiKey", backend.api_key);
+    backend.timeout_seconds = get_int_value(section, "TimeoutSeconds",
+                                            static_cast<int>(backend.timeout_seconds));
+    if (backend.timeout_seconds < 1) {
+        backend.timeout_seconds = 1;
+    }
+    backend.prompt_price_per_million = get_double_value(section, "PromptPricePerMillion",
+                                                        backend.prompt_price_per_million);
+    backend.completion_price_per_million = get_double_value(section, "CompletionPricePerMillion",
+                                                            backend.completion_price_per_million);
+    backend.structured_output = config.getValue(section, "StructuredOutput",
+                                                backend.structured_output ? "true" : "false") == "true";
+    return backend;
+}
+
+
+/**
+ * Writes an LLM backend description to the configuration file.
+ *
+ * @param section The section to write the backend keys to.
+ * @param backend The backend to store.
+ */
+void Settings::write_llm_backend(const std::string &section, const LLMBackend &backend)
+{
+    config.setValue(section, "BaseUrl", backend.base_url);
+    config.setValue(section, "Model", backend.model);
+    config.setValue(section, "AuthHeader", backend.auth_header);
+    config.setValue(section, "ApiKey", backend.api_key);
+    config.setValue(section, "TimeoutSeconds", std::to_string(backend.timeout_seconds));
+    config.setValue(section, "PromptPricePerMillion", std::to_string(backend.prompt_price_per_million));
+    config.setValue(section, "CompletionPricePerMillion", std::to_string(backend.completion_price_per_million));
+    config.setValue(section, "StructuredOutput", backend.structured_output ? "true" : "false");
+}
+
+
 /**
  * Saves the current settings to the configuration file.
  *
@@ -121,6 +262,22 @@ bool Settings::save() {
     config.setValue("Settings", "CategorizeFiles", categorize_files ? "true" : "false");
     config.setValue("Settings", "CategorizeDirectories", categorize_directories ? "true" : "false");
     config.setValue("Settings", "SortFolder", this->sort_folder);
+    config.setValue("Settings", "MaxConcurrentRequests", std::to_string(max_concurrent_requests));
+    config.setValue("Settings", "BatchSize", std::to_string(batch_size));
+    config.setValue("Settings", "MaxRetries", std::to_string(max_retries));
+    config.setValue("Settings", "RequestsPerMinute", std::to_string(requests_per_minute));
+    config.setValue("Settings", "TokensPerMinute", std::to_string(tokens_per_minute));
+    write_llm_backend("LLM", llm_backend);
+    config.setValue("Routing", "Enabled", routing_enabled ? "true" : "false");
+    config.setValue("Routing", "EscalationThreshold", std::to_string(escalation_threshold));
+    config.setValue("Routing", "EscalateConflicts", escalate_conflicts ? "true" : "false");
+    write_llm_backend("LLM.Strong", strong_llm_backend);
+    config.setValue("Classifier", "Enabled", classifier_enabled ? "true" : "false");
+    config.setValue("Classifier", "MinConfidence", std::to_string(classifier_min_confidence));
+    config.setValue("Classifier", "MinSamples", std::to_string(classifier_min_samples));
+    config.setValue("Cassette", "Mode", cassette_mode);
+    config.setValue("Cassette", "Path", cassette_path);
+    config.setValue("Cassette", "LatencyMs", std::to_string(cassette_latency_ms));
 
     if (!skipped_version.empty()) {
         config.setValue("Settings", "SkippedVersion", skipped_version);
@@ -220,6 +377,211 @@ void Settings::set_sort_folder(const std::string &path)
 }
 
 
+/**
+ * Retrieves the maximum number of categorization requests kept in flight.
+ *
+ * @return The size of the categorization worker pool, at least 1.
+ */
+int Settings::get_max_concurrent_requests() const
+{
+    return max_concurrent_requests > 0 ? max_concurrent_requests : 1;
+}
+
+
+/**
+ * Sets the maximum number of categorization requests kept in flight.
+ *
+ * @param value The size of the categorization worker pool.
+ */
+void Settings::set_max_concurrent_requests(int value)
+{
+    max_concurrent_requests = value;
+}
+
+
+/**
+ * Retrieves the number of entries sent to the LLM in a single request.
+ *
+ * @return The categorization batch size, at least 1.
+ */
+int Settings::get_batch_size() const
+{
+    return batch_size > 0 ? batch_size : 1;
+}
+
+
+/**
+ * Sets the number of entries sent to the LLM in a single request.
+ *
+ * @param value The categorization batch size.
+ */
+void Settings::set_batch_size(int value)
+{
+    batch_size = value;
+}
+
+
+/**
+ * Retrieves the number of attempts made for a failed LLM request.
+ *
+ * @return The maximum number of attempts per request, at least 1.
+ */
+int Settings::get_max_retries() const
+{
+    return max_retries > 0 ? max_retries : 1;
+}
+
+
+/**
+ * Retrieves the number of LLM requests allowed per minute.
+ *
+ * @return The request rate limit, at least 1.
+ */
+int Settings::get_requests_per_minute() const
+{
+    return requests_per_minute > 0 ? requests_per_minute : 1;
+}
+
+
+/**
+ * Retrieves the number of LLM tokens allowed per minute.
+ *
+ * @return The token rate limit, at least 1000.
+ */
+int Settings::get_tokens_per_minute() const
+{
+    return tokens_per_minute >= 1000 ? tokens_per_minute : 1000;
+}
+
+
+/**
+ * Retrieves the backend used for categorization requests.
+ *
+ * @return The endpoint, model, auth header and timeout from the [LLM] section.
+ */
+LLMBackend Settings::get_llm_backend() const
+{
+    return llm_backend;
+}
+
+
+/**
+ * Retrieves whether hard entries are escalated to a stronger model.
+ *
+ * @return True if the [Routing] section enables the strong tier, false if
+ *         every request goes to the [LLM] backend.
+ */
+bool Settings::get_routing_enabled() const
+{
+    return routing_enabled;
+}
+
+
+/**
+ * Retrieves the backend that answers the entries escalated by the router.
+ *
+ * @return The backend from the [LLM.Strong] section, by default gpt-4o on the OpenAI API.
+ */
+LLMBackend Settings::get_strong_llm_backend() const
+{
+    return strong_llm_backend;
+}
+
+
+/**
+ * Retrieves the confidence below which an answer of the fast tier is escalated.
+ *
+ * @return The escalation threshold, between 0 and 1.
+ */
+double Settings::get_escalation_threshold() const
+{
+    return std::clamp(escalation_threshold, 0.0, 1.0);
+}
+
+
+/**
+ * Retrieves whether contradicting answers for names of the same pattern are escalated.
+ *
+ * @return True if conflicting answers go to the strong tier.
+ */
+bool Settings::get_escalate_conflicts() const
+{
+    return escalate_conflicts;
+}
+
+
+/**
+ * Retrieves whether the local name classifier may answer instead of the LLM.
+ *
+ * Off unless enabled in [Classifier]: naive Bayes posteriors are overconfident,
+ * so on a small or skewed history MinConfidence alone does not keep wrong
+ * predictions from skipping the LLM.
+ *
+ * @return True if confident predictions skip the LLM.
+ */
+bool Settings::get_classifier_enabled() const
+{
+    return classifier_enabled;
+}
+
+
+/**
+ * Retrieves the confidence a prediction of the local classifier needs to be used.
+ *
+ * @return The minimum confidence, between 0 and 1.
+ */
+double Settings::get_classifier_min_confidence() const
+{
+    return std::clamp(classifier_min_confidence, 0.0, 1.0);
+}
+
+
+/**
+ * Retrieves the number of stored categorizations the local classifier needs
+ * before its predictions are trusted.
+ *
+ * @return The minimum number of training samples, at least 1.
+ */
+int Settings::get_classifier_min_samples() const
+{
+    return classifier_min_samples >= 1 ? classifier_min_samples : 1;
+}
+
+
+/**
+ * Retrieves the LLM cassette mode.
+ *
+ * @return "record" to save LLM responses, "replay" to serve them from the
+ *         cassette instead of the network, or "off".
+ */
+std::string Settings::get_cassette_mode() const
+{
+    return cassette_mode;
+}
+
+
+/**
+ * Retrieves the path of the LLM cassette file.
+ *
+ * @return The cassette path, by default llm_cassette.bin in the configuration directory.
+ */
+std::string Settings::get_cassette_path() const
+{
+    return cassette_path;
+}
+
+
+/**
+ * Retrieves the latency added to every response replayed from the cassette.
+ *
+ * @return The replay latency in milliseconds, at least 0.
+ */
+int Settings::get_cassette_latency_ms() const
+{
+    return cassette_latency_ms > 0 ? cassette_latency_ms : 0;
+}
+
+
 /**
  * Sets the skipped version setting.
  *
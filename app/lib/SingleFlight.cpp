@@ -0,0 +1,89 @@
+#include "SingleFlight.hpp"
+#include <algorithm>
+#include <cctype>
+
+
+/**
+ * @brief Builds the key under which a categorization request is deduplicated.
+ *
+ * Names are compared case-insensitively and without surrounding whitespace,
+ * and files and directories never share a key.
+ *
+ * @param file_name The name of the file or directory.
+ * @param file_type The type of the entry.
+ * @return The request key.
+ */
+std::string SingleFlight::make_key(const std::string &file_name, FileType file_type)
+{
+    const auto is_space = [](unsigned char c) { return std::isspace(c); };
+    auto first = std::find_if_not(file_name.begin(), file_name.end(), is_space);
+    auto last = std::find_if_not(file_name.rbegin(), file_name.rend(), is_space).base();
+
+    std::string key = (file_type == FileType::File) ? "F:" : "D:";
+    if (first < last) {
+        key.append(first, last);
+    }
+    std::transform(key.begin() + 2, key.end(), key.begin() + 2,
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return key;
+}
+
+
+/**
+ * @brief Attaches to the request for a key, or becomes its owner.
+ *
+ * The first caller for a key owns the request and must send it, then call
+ * complete(). Every later caller gets the shared result of that request,
+ * whether it is still in flight or already completed.
+ *
+ * @param key The request key, see make_key().
+ * @return Whether the caller owns the request, and the future of its result.
+ */
+SingleFlight::Ticket SingleFlight::join(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto [it, inserted] = flights.try_emplace(key);
+    if (inserted) {
+        it->second.result = it->second.promise.get_future().share();
+    }
+    return Ticket{inserted, it->second.result};
+}
+
+
+/**
+ * @brief Publishes the result of an owned request to everyone attached to it.
+ *
+ * Successful results are kept, so later lookups are answered without a request.
+ * A missing result is handed to the callers already waiting, but the key is
+ * forgotten so that the next lookup sends a new request.
+ *
+ * @param key The request key.
+ * @param result The categorization, or std::nullopt if the request failed.
+ */
+void SingleFlight::complete(const std::string &key, const Result &result)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = flights.find(key);
+    if (it == flights.end() || it->second.completed) {
+        return;
+    }
+
+    it->second.promise.set_value(result);
+    it->second.completed = true;
+
+    if (!result) {
+        flights.erase(it);
+    }
+}
+
+
+/**
+ * @brief Retrieves the number of requests in flight or completed.
+ */
+size_t SingleFlight::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return flights.size();
+}
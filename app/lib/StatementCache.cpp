@@ -0,0 +1,168 @@
+#include "StatementCache.hpp"
+#include <glib.h>
+#include <utility>
+
+
+/**
+ * @brief Wraps a statement handed out by the cache.
+ *
+ * @param stmt The prepared statement.
+ * @param slot The cache slot the statement belongs to, or nullptr for a
+ *             statement that is finalized when released.
+ */
+StatementCache::Statement::Statement(sqlite3_stmt *stmt, Slot *slot)
+    : stmt(stmt), slot(slot)
+{}
+
+
+StatementCache::Statement::Statement(Statement &&other) noexcept
+    : stmt(std::exchange(other.stmt, nullptr)), slot(std::exchange(other.slot, nullptr))
+{}
+
+
+StatementCache::Statement &StatementCache::Statement::operator=(Statement &&other) noexcept
+{
+    if (this != &other) {
+        release();
+        stmt = std::exchange(other.stmt, nullptr);
+        slot = std::exchange(other.slot, nullptr);
+    }
+    return *this;
+}
+
+
+/**
+ * @brief Returns the statement to the cache, reset and without bindings.
+ */
+StatementCache::Statement::~Statement()
+{
+    release();
+}
+
+
+/**
+ * @brief Makes the statement ready to be bound and stepped again, e.g. for the next row of a batch.
+ */
+void StatementCache::Statement::reset()
+{
+    if (stmt) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+}
+
+
+/**
+ * @brief Resets a cached statement and marks it free, or finalizes an uncached one.
+ *
+ * Resetting right away also ends the read transaction a statement that
+ * stopped at SQLITE_ROW keeps open, which would otherwise hold back WAL checkpoints.
+ */
+void StatementCache::Statement::release()
+{
+    if (!stmt) {
+        return;
+    }
+
+    if (slot) {
+        reset();
+        std::lock_guard<std::mutex> lock(*slot->mutex);
+        slot->in_use = false;
+    } else {
+        sqlite3_finalize(stmt);
+    }
+
+    stmt = nullptr;
+    slot = nullptr;
+}
+
+
+/**
+ * @brief Finalizes all cached statements.
+ */
+StatementCache::~StatementCache()
+{
+    clear();
+}
+
+
+/**
+ * @brief Sets the connection the statements are prepared on.
+ *
+ * @param db The open connection. Statements prepared on an earlier connection are finalized.
+ */
+void StatementCache::attach(sqlite3 *db)
+{
+    clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    this->db = db;
+}
+
+
+/**
+ * @brief Hands out the prepared statement for an SQL text, preparing it on first use.
+ *
+ * Statements are keyed by their SQL text and prepared with
+ * SQLITE_PREPARE_PERSISTENT, since they live as long as the connection. A
+ * statement is used by one caller at a time: while it is out, e.g. on another
+ * thread, callers get a one-off statement that is finalized after use.
+ *
+ * @param sql A single SQL statement.
+ *
+ * @return The statement, which goes back to the cache when it goes out of
+ *         scope, or an empty Statement if the SQL could not be prepared.
+ */
+StatementCache::Statement StatementCache::acquire(const char *sql)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!db) {
+        return Statement();
+    }
+
+    auto it = slots.find(sql);
+    if (it != slots.end() && !it->second.in_use) {
+        it->second.in_use = true;
+        return Statement(it->second.stmt, &it->second);
+    }
+
+    sqlite3_stmt *stmt = nullptr;
+    const unsigned int flags = it == slots.end() ? SQLITE_PREPARE_PERSISTENT : 0;
+    if (sqlite3_prepare_v3(db, sql, -1, flags, &stmt, nullptr) != SQLITE_OK) {
+        g_print("SQL error: %s\n", sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+        return Statement();
+    }
+
+    if (it != slots.end()) {
+        return Statement(stmt, nullptr);
+    }
+
+    Slot &slot = slots[sql];
+    slot.stmt = stmt;
+    slot.in_use = true;
+    slot.mutex = &mutex;
+    return Statement(stmt, &slot);
+}
+
+
+/**
+ * @brief Finalizes all cached statements. None of them may be in use.
+ */
+void StatementCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &[sql, slot] : slots) {
+        sqlite3_finalize(slot.stmt);
+    }
+    slots.clear();
+}
+
+
+/**
+ * @brief Returns the number of cached statements.
+ */
+size_t StatementCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return slots.size();
+}
@@ -1,6 +1,6 @@
 #include "Updater.hpp"
 #include "app_version.hpp"
-#include <curl/curl.h>
+#include "HttpTransport.hpp"
 #include <iostream>
 #include <stdexcept>
 #ifdef _WIN32
@@ -13,7 +13,6 @@
 #include <optional>
 #include <gtk/gtk.h>
 #include <gtk/gtktypes.h>
-#include <curl/easy.h>
 #include <glibmm/main.h>
 #include <future>
 
@@ -353,29 +352,11 @@ void Updater::display_update_dialog(bool is_required) {
 }
 
 
-/**
- * Helper function to write the response from curl into a string.
- * This function is designed to be used with libcurl's CURLOPT_WRITEFUNCTION.
- *
- * @param contents The data to be written to the string.
- * @param size The size of each element in the contents array.
- * @param nmemb The number of elements in the contents array.
- * @param userp A pointer to a string to append the contents to.
- *
- * @return The total size of the data written.
- */
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
-    return size * nmemb;
-}
-
-
 /**
  * @brief Fetches update metadata from the specified URL.
  *
- * This function initializes a cURL session to send a GET request to the
- * URL specified by the `update_spec_file_url` member variable. The response
- * is written to a string using the `WriteCallback` function. It handles
+ * This function sends a GET request through the shared HttpTransport to the
+ * URL specified by the `update_spec_file_url` member variable. It handles
  * various HTTP response codes to determine if the request was successful or
  * if there were errors such as network, authentication, or server issues.
  *
@@ -387,45 +368,15 @@ size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
  */
 
 std::string Updater::fetch_update_metadata() const {
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        throw std::runtime_error("Initialization Error: Failed to initialize cURL.");
-    }
-
-    CURLcode res;
-    std::string response_string;
-
-    // Set curl options
-    #ifdef _WIN32
-        std::string cert_path = std::filesystem::current_path().string() + "\\certs\\cacert.pem";
-        curl_easy_setopt(curl, CURLOPT_CAINFO, cert_path.c_str());
-    #endif
-
-    curl_easy_setopt(curl, CURLOPT_URL, update_spec_file_url.c_str());
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_string);
-
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-    // Perform the request
-    res = curl_easy_perform(curl);
-
-    // Handle errors
-    if (res != CURLE_OK) {
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-        throw std::runtime_error("Network Error: " + std::string(curl_easy_strerror(res)));
-    }
+    static const HeaderList headers = HttpTransport::make_header_list({"Content-Type: application/json"});
 
-    // Check HTTP response code
-    long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    HttpRequest request;
+    request.url = update_spec_file_url;
+    request.headers = headers.get();
+    request.timeout_seconds = 5L;
 
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    HttpResponse response = HttpTransport::shared().perform(request);
+    long http_code = response.status_code;
 
     if (http_code == 401) {
         throw std::runtime_error("Authentication Error: Invalid or missing API key.");
@@ -437,7 +388,7 @@ std::string Updater::fetch_update_metadata() const {
         throw std::runtime_error("Client Error: The server returned an error. Status code: " + std::to_string(http_code));
     }
 
-    return response_string;
+    return response.body;
 }
 
 